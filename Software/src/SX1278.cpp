@@ -28,27 +28,166 @@
 #include "defines.h"
 #include "globals.h"
 
+#if TARGET == TARGET_RS_1TO3
+    #include <avr/pgmspace.h>
+    #define PROGMEM_CUSTOM PROGMEM
+#elif TARGET == TARGET_RS_4
+    #define PROGMEM_CUSTOM
+#endif
+
+#define SX1278_SHADOW_LENGTH 9 // Registers with a shadow copy, see SX1278_get_shadow_index()
+
+#define SX1278_DDS_MARK_FREQ 1200 // Bell 202 tones in Hz
+#define SX1278_DDS_SPACE_FREQ 2200
+#define SX1278_DDS_BAUD_RATE 1200
+#define SX1278_DDS_TABLE_BITS 6 // 64 sine table entries, indexed by the upper phase bits
+#define SX1278_DDS_PHASE_INC(freq) ((uint16_t) (((uint32_t) (freq) * 65536UL + SX1278_DDS_SAMPLE_RATE / 2) / SX1278_DDS_SAMPLE_RATE)) // 16 bit phase accumulator step per sample
+
+#if TARGET == TARGET_RS_1TO3
+  #define SX1278_EDGE_TIMESTAMP micros() // No cycle counter, 4 us resolution
+  #define SX1278_EDGE_TICKS_PER_US 1
+#elif TARGET == TARGET_RS_4
+  #define SX1278_EDGE_TIMESTAMP ESP.getCycleCount()
+  #define SX1278_EDGE_TICKS_PER_US getCpuFrequencyMhz()
+#endif
+
 // Module globals
 #if SX1278_MOD_OPTION == MOD_F_HOP
   uint8_t freq_lsb_lo;
   uint8_t freq_lsb_hi;
+#elif SX1278_MOD_OPTION == MOD_F_HOP_DDS
+  // Sine * 127, generated by tools/afsk_dds.py --table
+  const int8_t sx1278_dds_sine[1 << SX1278_DDS_TABLE_BITS] PROGMEM_CUSTOM = {
+    0, 12, 25, 37, 49, 60, 71, 81, 90, 98, 106, 112, 117, 122, 125, 126,
+    127, 126, 125, 122, 117, 112, 106, 98, 90, 81, 71, 60, 49, 37, 25, 12,
+    0, -12, -25, -37, -49, -60, -71, -81, -90, -98, -106, -112, -117, -122, -125, -126,
+    -127, -126, -125, -122, -117, -112, -106, -98, -90, -81, -71, -60, -49, -37, -25, -12
+  };
+
+  uint32_t sx1278_dds_center_frf; // Carrier frequency register value
+  uint8_t sx1278_dds_amplitude; // Peak deviation in frequency register steps
+  uint16_t sx1278_dds_phase = 0; // Audio tone phase, 2^16 is one cycle
+  uint32_t sx1278_dds_next_us = 0; // Time of the next frequency update
+  uint16_t sx1278_dds_remainder = 0; // Fractional us of the sample period, in 1/SX1278_DDS_SAMPLE_RATE us
+#endif
+
+SPISettings sx1278_spi_settings(SX1278_SPI_CLOCK, MSBFIRST, SPI_MODE0);
+uint8_t sx1278_shadow[SX1278_SHADOW_LENGTH]; // Last written values of the TX configuration registers
+uint16_t sx1278_shadow_valid = 0; // Bit set per shadow register holding the register value
+
+#if SX1278_EDGE_TIMING == EDGE_TIMING_MEASURE
+  uint32_t sx1278_edge_timestamp = 0; // Timestamp of the last modulation edge
+  uint32_t sx1278_edge_delay = 0; // Requested delay after the last edge in us
+  uint32_t sx1278_edge_count = 0;
+  int32_t sx1278_edge_error_min = 0; // Time between edges minus requested delay in ticks
+  int32_t sx1278_edge_error_max = 0;
+  int64_t sx1278_edge_error_sum = 0;
 #endif
 
 // Module functions
+// Get shadow copy index of a register, -1 if not shadowed
+static int8_t SX1278_get_shadow_index(uint8_t address)
+{
+  switch(address)
+  {
+    case REG_OP_MODE: return 0;
+    case REG_FDEV_LSB: return 1;
+    case REG_FR_MSB: return 2;
+    case REG_FR_MID: return 3;
+    case REG_FR_LSB: return 4;
+    case REG_PA_CONFIG: return 5;
+    case REG_PACKET_CONFIG_2: return 6;
+    case REG_PLL_HOP: return 7;
+    case REG_PA_DAC: return 8;
+    default: return -1;
+  }
+}
+
+// Record written value in the shadow copy, returns false if the register holds it already
+static bool SX1278_update_shadow(uint8_t address, uint8_t reg_value)
+{
+  int8_t shadow_index = SX1278_get_shadow_index(address);
+  if(shadow_index < 0) return true;
+
+  if((sx1278_shadow_valid & (1 << shadow_index)) && sx1278_shadow[shadow_index] == reg_value) return false;
+
+  sx1278_shadow[shadow_index] = reg_value;
+  sx1278_shadow_valid |= 1 << shadow_index;
+
+  return true;
+}
+
+// Write contiguous registers in one SPI burst, the SX1278 increments the address after each byte
+static void SX1278_write_burst(uint8_t address, const uint8_t* p_values, uint8_t length)
+{
+  bool is_changed = false;
+  for(uint8_t i = 0; i < length; i++) is_changed |= SX1278_update_shadow(address + i, p_values[i]);
+  if(!is_changed) return; // Skip redundant write
+
+  SPI.beginTransaction(sx1278_spi_settings);
+  SX1278_NSS_LOW; // Select SX1278 SPI device
+  SPI.transfer(address | 0x80);
+  for(uint8_t i = 0; i < length; i++) SPI.transfer(p_values[i]);
+  SX1278_NSS_HIGH; // Clear SX1278 SPI device selection
+  SPI.endTransaction();
+}
+
+#if SX1278_EDGE_TIMING == EDGE_TIMING_MEASURE
+  // Timestamp modulation edge, the time since the last edge minus its requested delay is call overhead and jitter
+  static void SX1278_record_edge(uint32_t delay)
+  {
+    uint32_t timestamp = SX1278_EDGE_TIMESTAMP;
+
+    if(sx1278_edge_delay > 0)
+    {
+      int32_t error = (int32_t) (timestamp - sx1278_edge_timestamp) - (int32_t) (sx1278_edge_delay * SX1278_EDGE_TICKS_PER_US);
+      if(sx1278_edge_count == 0 || error < sx1278_edge_error_min) sx1278_edge_error_min = error;
+      if(sx1278_edge_count == 0 || error > sx1278_edge_error_max) sx1278_edge_error_max = error;
+      sx1278_edge_error_sum += error;
+      sx1278_edge_count++;
+    }
+
+    sx1278_edge_timestamp = SX1278_EDGE_TIMESTAMP; // Exclude the bookkeeping above
+    sx1278_edge_delay = delay;
+  }
+
+  // Print edge timing error of the last packet in ns
+  static void SX1278_print_edge_timing()
+  {
+    if(sx1278_edge_count == 0) return;
+
+    DEBUG_PRINT("[SX1278] Edges/error min/max/mean ns: ");
+    DEBUG_PRINT(sx1278_edge_count);
+    DEBUG_PRINT("/");
+    DEBUG_PRINT(sx1278_edge_error_min * 1000 / (int32_t) SX1278_EDGE_TICKS_PER_US);
+    DEBUG_PRINT("/");
+    DEBUG_PRINT(sx1278_edge_error_max * 1000 / (int32_t) SX1278_EDGE_TICKS_PER_US);
+    DEBUG_PRINT("/");
+    DEBUG_PRINTLN((int32_t) (sx1278_edge_error_sum * 1000 / SX1278_EDGE_TICKS_PER_US / sx1278_edge_count));
+
+    sx1278_edge_count = 0;
+    sx1278_edge_delay = 0;
+    sx1278_edge_error_sum = 0;
+  }
+
+  #define SX1278_RECORD_EDGE(delay) SX1278_record_edge(delay)
+#else
+  #define SX1278_RECORD_EDGE(delay)
+#endif
+
 static void SX1278_write_reg(uint8_t address, uint8_t reg_value)
 {
-  digitalWrite(SX1278_NSS, LOW);  // Select SX1278 SPI device
-  SPI.transfer(address | 0x80);             
-  SPI.transfer(reg_value);
-  digitalWrite(SX1278_NSS, HIGH);  // Clear SX1278 SPI device selection
+  SX1278_write_burst(address, &reg_value, 1);
 }
 
 static uint8_t SX1278_read_reg(uint8_t address)
 {
-  digitalWrite(SX1278_NSS, LOW);  // Select SX1278 SPI device
+  SPI.beginTransaction(sx1278_spi_settings);
+  SX1278_NSS_LOW; // Select SX1278 SPI device
   SPI.transfer(address & 0x7F);
   uint8_t reg_value = SPI.transfer(0);
-  digitalWrite(SX1278_NSS, HIGH);  // Clear SX1278 SPI device selection
+  SX1278_NSS_HIGH; // Clear SX1278 SPI device selection
+  SPI.endTransaction();
 
   return reg_value;
 }
@@ -59,7 +198,7 @@ void SX1278_begin(void)
   SPI.begin(); // Begin SPI communication
 
   pinMode(SX1278_NSS, OUTPUT);
-  digitalWrite(SX1278_NSS, HIGH);  // Clear SX1278 SPI device selection
+  SX1278_NSS_HIGH; // Clear SX1278 SPI device selection
 
   pinMode(SX1278_NRESET, OUTPUT);
   SX1278_enable();
@@ -75,6 +214,7 @@ void SX1278_enable(void)
 void SX1278_disable(void)
 {
   digitalWrite(SX1278_NRESET, LOW); // Disable SX1278
+  sx1278_shadow_valid = 0; // Registers return to their reset values
 }
 
 void SX1278_sleep(void)
@@ -86,18 +226,26 @@ void SX1278_sleep(void)
   // 3: 1->Low Frequency Mode
   // 2-0: 000->Sleep Mode
   SX1278_write_reg(REG_OP_MODE, 0x08);
+
+  #if SX1278_EDGE_TIMING == EDGE_TIMING_MEASURE
+    SX1278_print_edge_timing(); // Packet finished
+  #endif
 }
 
 void SX1278_reset(void)
 {
   digitalWrite(SX1278_NRESET, LOW); // Disable SX1278
+  sx1278_shadow_valid = 0; // Registers return to their reset values
   delay(5);
   digitalWrite(SX1278_NRESET, HIGH); // Enable SX1278
   delay(5);
 }
 
+// Registers already holding the requested value are skipped, a repeated key-up only writes the operating mode
 void SX1278_enable_TX_direct(uint64_t *freq, uint8_t pwr, uint16_t deviation)
 {
+  uint32_t setup_start_us = micros();
+
   SX1278_set_TX_frequency(freq);
   
   // Set packet mode config
@@ -117,7 +265,7 @@ void SX1278_enable_TX_direct(uint64_t *freq, uint8_t pwr, uint16_t deviation)
   // 2-0: 011->Transmitter Mode (TX)
   SX1278_write_reg(REG_OP_MODE, 0x0B);
 
-  #if SX1278_MOD_OPTION == MOD_F_HOP
+  #if SX1278_MOD_OPTION == MOD_F_HOP || SX1278_MOD_OPTION == MOD_F_HOP_DDS
     SX1278_write_reg(REG_PLL_HOP, 0xAD); // Set Fast_Hop_On (MSB bit) true to enable fast freq hopping
   #endif
 
@@ -125,31 +273,74 @@ void SX1278_enable_TX_direct(uint64_t *freq, uint8_t pwr, uint16_t deviation)
   else SX1278_set_TX_power(pwr, true); // For PWR between 5-20: Enable the +20dBm option on PA_BOOT
   
   SX1278_set_TX_deviation(freq, deviation);
+
+  DEBUG_PRINT("[SX1278] TX setup us: ");
+  DEBUG_PRINTLN(micros() - setup_start_us);
+
+  #if SX1278_MOD_OPTION == MOD_F_HOP_DDS
+    sx1278_dds_next_us = micros(); // Sample clock starts now
+    sx1278_dds_remainder = 0;
+  #endif
 }
 
 void SX1278_mod_direct_out(uint32_t delay)
 {
   #if SX1278_MOD_OPTION == MOD_DIO2
     // Use DIO2 on SX1278 as direct modulation output pin
-    digitalWrite(SX1278_DIO2, HIGH);
+    SX1278_DIO2_HIGH;
+    SX1278_RECORD_EDGE(delay);
     delayMicroseconds(delay);
-    digitalWrite(SX1278_DIO2, LOW);
+    SX1278_DIO2_LOW;
+    SX1278_RECORD_EDGE(delay);
     delayMicroseconds(delay);
   
   #elif SX1278_MOD_OPTION == MOD_F_HOP
     // Use frequency hopping for modulation
     // For fast frequency change, only change Frf_LSB of the 3 Frf bytes
     SX1278_write_reg(REG_FR_LSB, freq_lsb_lo);
+    SX1278_RECORD_EDGE(delay);
     delayMicroseconds(delay);
     SX1278_write_reg(REG_FR_LSB, freq_lsb_hi);
+    SX1278_RECORD_EDGE(delay);
     delayMicroseconds(delay);
   #endif
 }
 
+// Send one AFSK bit by stepping the carrier through the sine table at SX1278_DDS_SAMPLE_RATE, the tone phase carries over between bits
+void SX1278_mod_dds_bit(bool is_mark)
+{
+  #if SX1278_MOD_OPTION == MOD_F_HOP_DDS
+    uint16_t phase_inc = is_mark ? SX1278_DDS_PHASE_INC(SX1278_DDS_MARK_FREQ) : SX1278_DDS_PHASE_INC(SX1278_DDS_SPACE_FREQ);
+
+    for(uint8_t i = 0; i < SX1278_DDS_SAMPLE_RATE / SX1278_DDS_BAUD_RATE; i++)
+    {
+      sx1278_dds_phase += phase_inc;
+      int8_t sine = pgm_read_byte_near(sx1278_dds_sine + (sx1278_dds_phase >> (16 - SX1278_DDS_TABLE_BITS)));
+      uint32_t frf = sx1278_dds_center_frf + (((int16_t) sine * sx1278_dds_amplitude) >> 7);
+      uint8_t frf_bytes[3] = {(uint8_t) (frf >> 16), (uint8_t) (frf >> 8), (uint8_t) frf};
+
+      while((int32_t) (micros() - sx1278_dds_next_us) < 0); // Wait for the sample time, bit processing and SPI time do not shift the tones
+
+      SX1278_write_burst(REG_FR_MSB, frf_bytes, sizeof(frf_bytes)); // Frequency changes with the LSB write, a carry into MID or MSB is written along
+      SX1278_RECORD_EDGE(1000000UL / SX1278_DDS_SAMPLE_RATE);
+
+      // Advance sample clock by 1000000 / SX1278_DDS_SAMPLE_RATE us without accumulating rounding errors
+      sx1278_dds_next_us += 1000000UL / SX1278_DDS_SAMPLE_RATE;
+      sx1278_dds_remainder += 1000000UL % SX1278_DDS_SAMPLE_RATE;
+      if(sx1278_dds_remainder >= SX1278_DDS_SAMPLE_RATE)
+      {
+        sx1278_dds_remainder -= SX1278_DDS_SAMPLE_RATE;
+        sx1278_dds_next_us++;
+      }
+    }
+  #endif
+}
+
 void SX1278_set_direct__out(bool value)
 {
   // Use DIO2 on SX1278 as direct modulation output pin
-  digitalWrite(SX1278_DIO2, value);
+  if(value) SX1278_DIO2_HIGH;
+  else SX1278_DIO2_LOW;
 }
 
 void SX1278_set_TX_deviation(uint64_t *freq, uint16_t deviation)
@@ -170,6 +361,14 @@ void SX1278_set_TX_deviation(uint64_t *freq, uint16_t deviation)
     // Frf_LSB for high an low FSK frequency needed for fast frequency hopping
     freq_lsb_lo = (uint32_t) ((*freq + SX1278_FREQUENCY_CORRECTION - deviation / 2)  << 19) / SX1278_CRYSTAL_FREQ; // Frf_LSB with carrier frequency + deviation
     freq_lsb_hi = (uint32_t) ((*freq + SX1278_FREQUENCY_CORRECTION + deviation / 2)  << 19) / SX1278_CRYSTAL_FREQ; // Frf_LSB with carrier frequency + deviation
+
+  #elif SX1278_MOD_OPTION == MOD_F_HOP_DDS
+    // Set original TX deviation reg to 0 Hz -> deviation comes from the frequency steps
+    SX1278_write_reg(REG_FDEV_LSB, 0);
+
+    // Freg = (Frf * 2^19) / Fxo, resolution is 61.035 Hz if Fxo = 32 MHz
+    sx1278_dds_center_frf = ((*freq + SX1278_FREQUENCY_CORRECTION) << 19) / SX1278_CRYSTAL_FREQ;
+    sx1278_dds_amplitude = (((uint32_t) deviation << 19) + SX1278_CRYSTAL_FREQ / 2) / SX1278_CRYSTAL_FREQ;
   #endif
 }
 
@@ -204,9 +403,8 @@ void SX1278_set_TX_frequency(uint64_t *freq)
   // Resolution is 61.035 Hz if Fxo = 32 MHz
   freq_tmp = (((freq_tmp + SX1278_FREQUENCY_CORRECTION) << 19) / SX1278_CRYSTAL_FREQ);
 
-  SX1278_write_reg(REG_FR_MSB, freq_tmp >> 16);  // Write MSB of RF carrier freq
-  SX1278_write_reg(REG_FR_MID, freq_tmp >> 8);  // Write MID of RF carrier freq
-  SX1278_write_reg(REG_FR_LSB, freq_tmp);  // Write LSB of RF carrier freq
+  uint8_t frf[3] = {(uint8_t) (freq_tmp >> 16), (uint8_t) (freq_tmp >> 8), (uint8_t) freq_tmp}; // MSB, MID and LSB of RF carrier freq
+  SX1278_write_burst(REG_FR_MSB, frf, sizeof(frf));
 }
 
 // This measurement must be performed with SX1278 in FSTx or FSRx mode!
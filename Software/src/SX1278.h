@@ -34,6 +34,7 @@ void SX1278_reset(void);
 void SX1278_enable_TX_direct(uint64_t *freq, uint8_t pwr, uint16_t deviation);
 
 void SX1278_mod_direct_out(uint32_t delay);
+void SX1278_mod_dds_bit(bool is_mark);
 void SX1278_set_direct__out(bool value);
 
 void SX1278_set_TX_deviation(uint64_t *freq, uint16_t deviation);
@@ -34,15 +34,19 @@ uint8_t consecutive_true_bit_counter = 0; // Used by bit stuffing
 // Module functions
 static void ax25_set_rectangle_wave_out(bool rectangle_wave_out_state)
 {
-  if(rectangle_wave_out_state)
-  {
-    SX1278_mod_direct_out(APRS_1200_MARK_DELAY); // Send 1200Hz mark for ~833us, so theoretical a delay between state changes of ~417us
-  }
-  else
-  {
-    SX1278_mod_direct_out(APRS_2400_SPACE_DELAY); // Send first 2400Hz space for ~417us, so theoretical a delay between state changes of ~208s
-    SX1278_mod_direct_out(APRS_2400_SPACE_DELAY); // Send second 2400Hz space for ~417us, so theoretical a delay between state changes of ~208us
-  }
+  #if SX1278_MOD_OPTION == MOD_F_HOP_DDS
+    SX1278_mod_dds_bit(rectangle_wave_out_state); // Send 1200Hz mark or 2200Hz space for one bit, phase continuous
+  #else
+    if(rectangle_wave_out_state)
+    {
+      SX1278_mod_direct_out(APRS_1200_MARK_DELAY); // Send 1200Hz mark for ~833us, so theoretical a delay between state changes of ~417us
+    }
+    else
+    {
+      SX1278_mod_direct_out(APRS_2400_SPACE_DELAY); // Send first 2400Hz space for ~417us, so theoretical a delay between state changes of ~208s
+      SX1278_mod_direct_out(APRS_2400_SPACE_DELAY); // Send second 2400Hz space for ~417us, so theoretical a delay between state changes of ~208us
+    }
+  #endif
 }
 
 static void ax25_calc_crc(uint16_t *crc, bool bit)
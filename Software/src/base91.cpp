@@ -0,0 +1,138 @@
+/*
+ * This file is part of a radiosonde firmware.
+ * 
+ 
+ * Copyright (C) 2023  Amon Schumann / DL9AS
+ 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */ 
+
+#include <Arduino.h>
+
+#include "base91.h"
+
+/*
+ * basE91 binary to text encoding:
+ * Takes 13 bits at a time (14 bits, if the 13 bit value is small enough) and writes them as two characters of a 91
+ * character alphabet, about 23% overhead instead of 33% with Base64. The alphabet is '!' to 'z' and '}', which are
+ * all legal in APRS status text. '|' and '~' are not allowed there and '{' starts an APRS message ID.
+ */
+
+#define BASE91_CHAR_LAST '}' // Character of value 90, '!' to 'z' are the values 0 to 89
+
+// Module functions
+
+// Get character for a value 0-90
+static char base91_get_char(uint8_t value)
+{
+  return value < 90 ? '!' + value : BASE91_CHAR_LAST;
+}
+
+#ifdef BASE91_DECODE_ENABLE
+  // Get value 0-90 for a character, 0xFF if not part of the alphabet
+  static uint8_t base91_get_value(char c)
+  {
+    if(c >= '!' && c <= 'z') return c - '!';
+    if(c == BASE91_CHAR_LAST) return 90;
+
+    return 0xFF;
+  }
+#endif
+
+// Exported functions
+
+// Encode length bytes into p_text (BASE91_ENCODED_LENGTH(length) bytes), returns number of characters without terminator
+size_t base91_encode(const uint8_t* p_data, size_t length, char* p_text)
+{
+  uint32_t bits = 0;
+  uint8_t bit_count = 0;
+  size_t text_index = 0;
+
+  for(size_t i = 0; i < length; i++)
+  {
+    bits |= (uint32_t) p_data[i] << bit_count;
+    bit_count += 8;
+
+    if(bit_count > 13)
+    {
+      uint16_t value = bits & 0x1FFF; // Take 13 bits
+      if(value > 88)
+      {
+        bits >>= 13;
+        bit_count -= 13;
+      }
+      else // 13 bit value small enough to take 14 bits
+      {
+        value = bits & 0x3FFF;
+        bits >>= 14;
+        bit_count -= 14;
+      }
+
+      p_text[text_index++] = base91_get_char(value % 91);
+      p_text[text_index++] = base91_get_char(value / 91);
+    }
+  }
+
+  // Remaining bits
+  if(bit_count > 0)
+  {
+    p_text[text_index++] = base91_get_char(bits % 91);
+    if(bit_count > 7 || bits > 90) p_text[text_index++] = base91_get_char(bits / 91);
+  }
+
+  p_text[text_index] = '\0';
+
+  return text_index;
+}
+
+#ifdef BASE91_DECODE_ENABLE
+  // Decode p_text into p_data (BASE91_DECODED_LENGTH(strlen(p_text)) bytes) and set p_length to the number of bytes,
+  // returns false on characters outside the alphabet like decode() of tools/base91.py
+  bool base91_decode(const char* p_text, uint8_t* p_data, size_t* p_length)
+  {
+    uint32_t bits = 0;
+    uint8_t bit_count = 0;
+    int16_t value = -1; // First character of a pair
+    size_t data_index = 0;
+
+    for(; *p_text != '\0'; p_text++)
+    {
+      uint8_t c = base91_get_value(*p_text);
+      if(c == 0xFF) return false;
+
+      if(value < 0)
+      {
+        value = c;
+        continue;
+      }
+
+      value += c * 91;
+      bits |= (uint32_t) value << bit_count;
+      bit_count += (value & 0x1FFF) > 88 ? 13 : 14;
+      do
+      {
+        p_data[data_index++] = bits & 0xFF;
+        bits >>= 8;
+        bit_count -= 8;
+      } while(bit_count > 7);
+      value = -1;
+    }
+
+    // Remaining character
+    if(value >= 0) p_data[data_index++] = (bits | (uint32_t) value << bit_count) & 0xFF;
+
+    *p_length = data_index;
+    return true;
+  }
+#endif
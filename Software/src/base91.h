@@ -0,0 +1,35 @@
+/*
+ * This file is part of a radiosonde firmware.
+ * 
+ 
+ * Copyright (C) 2023  Amon Schumann / DL9AS
+ 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */ 
+
+#ifndef __BASE91__H__
+#define __BASE91__H__
+
+#include <Arduino.h>
+
+#define BASE91_ENCODED_LENGTH(length) (((length) * 16 + 12) / 13 + 1) // Worst case characters for length bytes, including string terminator
+#define BASE91_DECODED_LENGTH(length) (((length) * 7 + 7) / 8) // Worst case bytes for length characters, a trailing single character gives one byte
+
+// Exported functions
+size_t base91_encode(const uint8_t* p_data, size_t length, char* p_text);
+#ifdef BASE91_DECODE_ENABLE // Host only, the firmware never receives basE91, see tools/base91.py --self-test
+  bool base91_decode(const char* p_text, uint8_t* p_data, size_t* p_length);
+#endif
+
+#endif
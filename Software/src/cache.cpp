@@ -23,49 +23,698 @@
 #include "cache.h"
 #include "config.h"
 #include "globals.h"
-#include <Preferences.h> // Non-volatile storage
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/*
+ * Cache tiers:
+ * Tier 0 holds the newest CACHE_LENGTH positions at full rate. Every push is also copied into each coarse tier, if at
+ * least the tier interval passed since the newest position of that tier. So older parts of the flight stay covered
+ * hourly, 6-hourly and daily, and a cache frame can summarize the whole flight. Tier maintenance is O(1) per push.
+ *
+ * Cache log format:
+ * The cache partition is used as a ring of flash sectors. Every cached position is appended as one 16 byte entry,
+ * so storing a position only programs 16 bytes. The sector following the write sector holds the oldest entries and
+ * is erased in the background by cache_compact() before the log reaches it. Coarse tier entries still in use are
+ * copied forward before their sector is erased. On boot the RAM rings are rebuilt by replaying the log from the
+ * oldest sector on, so a replaced newest position overrides its earlier entry.
+ *
+ * After boot the cache is only served from RAM. Positions pushed since the last store are dirty until cache_store()
+ * appends them, which also happens automatically before a software restart. All exported functions take the cache
+ * mutex, so the cache can be consulted from other tasks as well.
+ */
+
+/* Cache frame format:
+
+  Sample: {[POINT][DELTA][DELTA]...|[MSB][LSB]
+
+  {             Start flag of the delta encoded track history
+  [POINT]       Newest position at full resolution, 4 numbers:
+                  latitude [deg*100] + 9000, longitude [deg*100] + 18000, altitude [m],
+                  time [minutes since 2000-01-01 UTC modulo 65536]
+  [DELTA]       Each next older position as difference to the position sent before, 4 numbers:
+                  zigzag(latitude difference), zigzag(longitude difference, wrapped to -18000:18000),
+                  zigzag(altitude difference), minutes back in time (modulo 65536)
+  |             End flag
+  [MSB][LSB]    Number of positions cached since start of flight, ASCII Base91 encoded
+
+  The newest positions are taken from tier 0, the older ones from the coarse tiers. As long as a coarser tier
+  reaches further back in time, each tier fills at most its share of the frame (CACHE_FRAME_TIER_SHARES) and
+  space it does not use moves on to the next tier. The tier reaching back to the start of the flight gets the
+  rest of the frame and is thinned out to every 2nd, 3rd ... position until its oldest position fits. So the
+  frame carries recent full rate detail as well as a summary of the whole flight.
+
+  Numbers are variable length: each character carries a digit 0-44 plus 33 for ASCII Base91 encoding,
+  least significant digit first. 45 is added to every digit except the last one of a number.
+  zigzag(x) maps signed to unsigned: 0, -1, 1, -2, 2 ... -> 0, 1, 2, 3, 4 ... */
+
+#define CACHE_VARINT_BASE 45
+
+#define CACHE_TIER_COUNT 4 // Tier 0 full rate and 3 coarse tiers
+
+// Coarse tier ring
+typedef struct
+{
+  cache_tier_entry_t* ring;
+  uint16_t length;
+  uint16_t interval; // Minimum minutes between positions
+  uint16_t head; // Index of the next entry to be written
+  uint16_t size; // Number of entries in the ring
+  uint16_t unstored; // Number of newest entries not yet appended to the log
+} cache_tier_t;
+
+// Cache log entry, erased flash reads 0xFF
+typedef struct
+{
+  uint32_t sequence; // Increments with every log entry
+  cache_position_t position;
+  uint16_t element_number; // Element number of the position, starting at 1
+  uint8_t tier; // Tier the entry belongs to
+  uint8_t checksum;
+} cache_log_entry_t;
+
+#define CACHE_LOG_ENTRIES_PER_READ 32 // Entries read at once while rebuilding
+
+// Cache frame encoder state across tiers
+typedef struct
+{
+  cache_position_t previous_position; // Last encoded position, reference of the next difference
+  uint16_t last_age; // Age of the last encoded position
+  bool is_first;
+} cache_frame_state_t;
 
 // Module globals
-Preferences* p_cache_preferences;
-uint16_t element_number;
-char cache_buf[CACHE_LENGTH+4];
+cache_position_t cache_ring[CACHE_LENGTH]; // Ring buffer of cached positions
+uint16_t cache_head = 0; // Index of the next position to be written
+uint16_t element_number = 0; // Number of positions pushed since start of flight
+uint16_t stored_element_number = 0; // Number of positions already appended to the log
+
+cache_tier_entry_t cache_tier1_ring[CACHE_TIER1_LENGTH];
+cache_tier_entry_t cache_tier2_ring[CACHE_TIER2_LENGTH];
+cache_tier_entry_t cache_tier3_ring[CACHE_TIER3_LENGTH];
+cache_tier_t cache_tiers[CACHE_TIER_COUNT] = { // Index 0 unused, tier 0 is cache_ring
+  {NULL, 0, 0, 0, 0, 0},
+  {cache_tier1_ring, CACHE_TIER1_LENGTH, CACHE_TIER1_INTERVAL, 0, 0, 0},
+  {cache_tier2_ring, CACHE_TIER2_LENGTH, CACHE_TIER2_INTERVAL, 0, 0, 0},
+  {cache_tier3_ring, CACHE_TIER3_LENGTH, CACHE_TIER3_INTERVAL, 0, 0, 0}
+};
+
+const esp_partition_t* p_cache_partition = NULL;
+uint32_t cache_log_offset = 0; // Partition offset of the next free log entry
+uint32_t cache_log_sequence = 0; // Sequence number of the next log entry
+int16_t cache_log_erase_sector = -1; // Sector to be erased in background, -1 if none
+
+SemaphoreHandle_t cache_mutex = NULL; // Recursive, so callers can hold it across several cache calls
+
+const uint8_t cache_frame_tier_shares[CACHE_TIER_COUNT] = CACHE_FRAME_TIER_SHARES; // Percent of a cache frame per tier
+
+// Module functions
+static void cache_log_append(uint8_t tier, uint16_t number, cache_position_t position);
+
+// Age of an element number relative to the newest position, 0 is newest
+static uint16_t cache_get_age(uint16_t number)
+{
+  return element_number - number;
+}
+
+static uint16_t cache_tier_get_size(uint8_t tier)
+{
+  if(tier == 0) return cache_get_size();
+  return cache_tiers[tier].size;
+}
+
+// Get position of a tier by index, 0 is newest
+static cache_tier_entry_t cache_tier_get(uint8_t tier, uint16_t index)
+{
+  cache_tier_entry_t entry;
+
+  if(tier == 0)
+  {
+    entry.position = cache_ring[(cache_head + CACHE_LENGTH - 1 - index) % CACHE_LENGTH];
+    entry.element_number = element_number - index;
+  }
+  else
+  {
+    cache_tier_t* p_tier = &cache_tiers[tier];
+    entry = p_tier->ring[(p_tier->head + p_tier->length - 1 - index) % p_tier->length];
+  }
+
+  return entry;
+}
+
+static void cache_tier_push(uint8_t tier, cache_tier_entry_t entry)
+{
+  cache_tier_t* p_tier = &cache_tiers[tier];
+
+  p_tier->ring[p_tier->head] = entry; // Overwrite oldest entry if tier full
+
+  p_tier->head++;
+  if(p_tier->head >= p_tier->length) p_tier->head = 0;
+  if(p_tier->size < p_tier->length) p_tier->size++;
+  if(p_tier->unstored < p_tier->size) p_tier->unstored++; // Entries already shifted out are lost
+}
+
+// Check if a coarse tier still holds an element number
+static bool cache_tier_contains(uint8_t tier, uint16_t number)
+{
+  for(uint16_t i = 0; i < cache_tiers[tier].size; i++) if(cache_tier_get(tier, i).element_number == number) return true;
+
+  return false;
+}
+
+// Insert entry sorted by age while rebuilding, the ring is kept linear with the oldest entry at index 0
+static void cache_tier_insert(uint8_t tier, cache_tier_entry_t entry)
+{
+  cache_tier_t* p_tier = &cache_tiers[tier];
+  uint16_t age = cache_get_age(entry.element_number);
+
+  // Find first entry that is not older
+  uint16_t index = 0;
+  while(index < p_tier->size && cache_get_age(p_tier->ring[index].element_number) > age) index++;
+
+  if(index < p_tier->size && p_tier->ring[index].element_number == entry.element_number) // Same entry copied forward
+  {
+    p_tier->ring[index] = entry;
+    return;
+  }
+
+  if(p_tier->size == p_tier->length) // Drop oldest entry
+  {
+    if(index == 0) return; // New entry is the oldest
+    memmove(&p_tier->ring[0], &p_tier->ring[1], (index - 1) * sizeof(cache_tier_entry_t));
+    index--;
+  }
+  else
+  {
+    memmove(&p_tier->ring[index + 1], &p_tier->ring[index], (p_tier->size - index) * sizeof(cache_tier_entry_t));
+    p_tier->size++;
+  }
+
+  p_tier->ring[index] = entry;
+  p_tier->head = p_tier->size % p_tier->length;
+}
+
+static uint8_t cache_log_checksum(const cache_log_entry_t* entry)
+{
+  const uint8_t* entry_bytes = (const uint8_t*) entry;
+  uint8_t checksum = 0;
+
+  for(uint8_t i = 0; i < sizeof(cache_log_entry_t) - 1; i++) checksum += entry_bytes[i];
+
+  return ~checksum;
+}
+
+static bool cache_log_entry_is_valid(const cache_log_entry_t* entry)
+{
+  return entry->sequence != 0xFFFFFFFF && entry->tier < CACHE_TIER_COUNT && entry->checksum == cache_log_checksum(entry);
+}
+
+static bool cache_log_entry_is_blank(const cache_log_entry_t* entry)
+{
+  const uint8_t* entry_bytes = (const uint8_t*) entry;
+
+  for(uint8_t i = 0; i < sizeof(cache_log_entry_t); i++) if(entry_bytes[i] != 0xFF) return false;
+
+  return true;
+}
+
+static uint16_t cache_log_sector_count(void)
+{
+  return p_cache_partition->size / SPI_FLASH_SEC_SIZE;
+}
+
+static void cache_log_erase(uint16_t sector)
+{
+  DEBUG_PRINT("[CACHE] Erase sector: ");
+  DEBUG_PRINTLN(sector);
+
+  esp_partition_erase_range(p_cache_partition, sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE);
+  if(cache_log_erase_sector == sector) cache_log_erase_sector = -1;
+}
+
+// Copy coarse tier entries still in use from a sector to the write sector, as long as they fit
+static void cache_log_copy_forward(uint16_t sector)
+{
+  cache_log_entry_t entries[CACHE_LOG_ENTRIES_PER_READ];
+
+  uint32_t sector_offset = sector * SPI_FLASH_SEC_SIZE;
+
+  for(uint32_t offset = sector_offset; offset < sector_offset + SPI_FLASH_SEC_SIZE; offset += sizeof(entries))
+  {
+    esp_partition_read(p_cache_partition, offset, entries, sizeof(entries));
+
+    for(uint8_t i = 0; i < CACHE_LOG_ENTRIES_PER_READ; i++)
+    {
+      if(!cache_log_entry_is_valid(&entries[i]) || entries[i].tier == 0) continue;
+      if(!cache_tier_contains(entries[i].tier, entries[i].element_number)) continue;
+
+      if(SPI_FLASH_SEC_SIZE - cache_log_offset % SPI_FLASH_SEC_SIZE <= sizeof(cache_log_entry_t)) return; // Keep last entry of the write sector free
+
+      cache_log_append(entries[i].tier, entries[i].element_number, entries[i].position);
+    }
+  }
+}
+
+// Schedule background erase of the sector following the write sector, if it is not blank already
+static void cache_log_schedule_erase(bool copy_forward)
+{
+  uint16_t next_sector = (cache_log_offset / SPI_FLASH_SEC_SIZE + 1) % cache_log_sector_count();
+
+  cache_log_entry_t entry;
+  esp_partition_read(p_cache_partition, next_sector * SPI_FLASH_SEC_SIZE, &entry, sizeof(entry));
+
+  if(cache_log_entry_is_blank(&entry))
+  {
+    cache_log_erase_sector = -1;
+  }
+  else
+  {
+    if(copy_forward) cache_log_copy_forward(next_sector);
+    cache_log_erase_sector = next_sector;
+  }
+}
+
+// Move write offset to the next entry, entering a new sector requires it to be erased
+static void cache_log_advance(void)
+{
+  cache_log_offset += sizeof(cache_log_entry_t);
+  if(cache_log_offset >= p_cache_partition->size) cache_log_offset = 0;
+
+  if(cache_log_offset % SPI_FLASH_SEC_SIZE == 0) // Entered new sector
+  {
+    uint16_t sector = cache_log_offset / SPI_FLASH_SEC_SIZE;
+    if(cache_log_erase_sector == sector) cache_log_erase(sector); // Background erase did not run in time
+
+    cache_log_schedule_erase(true);
+  }
+}
+
+// Rebuild RAM rings from the newest log entries
+static void cache_log_rebuild(void)
+{
+  cache_log_entry_t entries[CACHE_LOG_ENTRIES_PER_READ];
+  bool log_is_empty = true;
+  uint32_t newest_sequence = 0;
+  uint32_t newest_offset = 0;
+  uint32_t newest_position_sequence = 0;
+
+  // First pass: find newest entry and newest position, copied tier entries may be newer than the newest position
+  element_number = 0;
+  for(uint32_t offset = 0; offset < p_cache_partition->size; offset += sizeof(entries))
+  {
+    esp_partition_read(p_cache_partition, offset, entries, sizeof(entries));
+
+    for(uint8_t i = 0; i < CACHE_LOG_ENTRIES_PER_READ; i++)
+    {
+      if(cache_log_entry_is_valid(&entries[i]) && (log_is_empty || entries[i].sequence > newest_sequence))
+      {
+        log_is_empty = false;
+        newest_sequence = entries[i].sequence;
+        newest_offset = offset + i * sizeof(cache_log_entry_t);
+      }
+      if(cache_log_entry_is_valid(&entries[i]) && entries[i].tier == 0 && entries[i].sequence >= newest_position_sequence)
+      {
+        newest_position_sequence = entries[i].sequence;
+        element_number = entries[i].element_number;
+      }
+    }
+  }
+
+  for(uint8_t tier = 1; tier < CACHE_TIER_COUNT; tier++)
+  {
+    cache_tiers[tier].size = 0;
+    cache_tiers[tier].unstored = 0;
+  }
+
+  // Second pass: replay the log from the oldest sector on, newer entries override older ones
+  uint16_t sector_count = cache_log_sector_count();
+  uint16_t newest_sector = newest_offset / SPI_FLASH_SEC_SIZE;
+  for(uint16_t s = 1; s <= sector_count && !log_is_empty; s++)
+  {
+    uint32_t sector_offset = ((newest_sector + s) % sector_count) * SPI_FLASH_SEC_SIZE;
+
+    for(uint32_t offset = sector_offset; offset < sector_offset + SPI_FLASH_SEC_SIZE; offset += sizeof(entries))
+    {
+      esp_partition_read(p_cache_partition, offset, entries, sizeof(entries));
+
+      for(uint8_t i = 0; i < CACHE_LOG_ENTRIES_PER_READ; i++)
+      {
+        if(!cache_log_entry_is_valid(&entries[i]) || entries[i].element_number == 0) continue;
+
+        if(entries[i].tier == 0) // Only the newest CACHE_LENGTH element numbers are kept
+        {
+          if(cache_get_age(entries[i].element_number) < CACHE_LENGTH) cache_ring[(entries[i].element_number - 1) % CACHE_LENGTH] = entries[i].position;
+        }
+        else
+        {
+          cache_tier_entry_t entry = {entries[i].position, entries[i].element_number};
+          cache_tier_insert(entries[i].tier, entry);
+        }
+      }
+    }
+  }
+
+  stored_element_number = element_number;
+  cache_head = element_number % CACHE_LENGTH;
+  cache_log_sequence = newest_sequence + 1;
+
+  // Continue writing after the newest entry
+  if(!log_is_empty)
+  {
+    cache_log_offset = newest_offset;
+    cache_log_schedule_erase(false); // Write sector is full up to the newest entry
+    cache_log_advance();
+  }
+  else // Fresh or unreadable log
+  {
+    cache_log_offset = SPI_FLASH_SEC_SIZE * (cache_log_sector_count() - 1);
+    cache_log_schedule_erase(false); // Sector 0 needs to be erased, if not blank
+    cache_log_offset = 0;
+    if(cache_log_erase_sector == 0) cache_log_erase(0);
+    cache_log_schedule_erase(false);
+  }
+
+  // Skip entries damaged by a reset while writing
+  cache_log_entry_t entry;
+  esp_partition_read(p_cache_partition, cache_log_offset, &entry, sizeof(entry));
+  while(!cache_log_entry_is_blank(&entry))
+  {
+    cache_log_advance();
+    esp_partition_read(p_cache_partition, cache_log_offset, &entry, sizeof(entry));
+  }
+
+  DEBUG_PRINT("[CACHE] Rebuilt: ");
+  DEBUG_PRINTLN(element_number);
+}
+
+static void cache_log_append(uint8_t tier, uint16_t number, cache_position_t position)
+{
+  cache_log_entry_t entry;
+  entry.sequence = cache_log_sequence++;
+  entry.position = position;
+  entry.element_number = number;
+  entry.tier = tier;
+  entry.checksum = cache_log_checksum(&entry);
+
+  esp_partition_write(p_cache_partition, cache_log_offset, &entry, sizeof(entry));
+  cache_log_advance();
+}
+
+// Append number as variable length Base91 characters, returns false if it does not fit
+static bool cache_encode_number(char* buf, uint16_t* length, uint16_t max_length, uint32_t value)
+{
+  do
+  {
+    if(*length >= max_length) return false;
+
+    uint8_t digit = value % CACHE_VARINT_BASE;
+    value = value / CACHE_VARINT_BASE;
+    if(value > 0) digit += CACHE_VARINT_BASE; // More digits follow
+
+    buf[(*length)++] = digit + 33; // Add 33 for ASCII Base91 encoding
+  } while(value > 0);
+
+  return true;
+}
+
+// Map signed to unsigned, so small negative differences stay short
+static uint32_t cache_zigzag(int32_t value)
+{
+  return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+// Append position to cache frame, newest at full resolution and older ones as difference to the previous one
+static bool cache_encode_position(char* buf, uint16_t* length, uint16_t max_length, const cache_position_t* position, const cache_position_t* previous_position)
+{
+  if(previous_position == NULL)
+  {
+    return cache_encode_number(buf, length, max_length, position->latitude + 9000)
+        && cache_encode_number(buf, length, max_length, position->longitude + 18000)
+        && cache_encode_number(buf, length, max_length, position->altitude)
+        && cache_encode_number(buf, length, max_length, position->time);
+  }
+
+  int32_t longitude_delta = position->longitude - previous_position->longitude;
+  if(longitude_delta > 18000) longitude_delta -= 36000; // Crossing the date line
+  else if(longitude_delta < -18000) longitude_delta += 36000;
+
+  return cache_encode_number(buf, length, max_length, cache_zigzag(position->latitude - previous_position->latitude))
+      && cache_encode_number(buf, length, max_length, cache_zigzag(longitude_delta))
+      && cache_encode_number(buf, length, max_length, cache_zigzag(position->altitude - previous_position->altitude))
+      && cache_encode_number(buf, length, max_length, (uint16_t) (previous_position->time - position->time));
+}
+
+// Append every stride-th position of a tier not covered by a finer tier, newest first and always the oldest one,
+// returns false if the frame is full before the oldest position
+static bool cache_encode_tier(char* buf, uint16_t* length, uint16_t max_length, uint8_t tier, uint16_t stride, cache_frame_state_t* state)
+{
+  uint16_t size = cache_tier_get_size(tier);
+  uint16_t i = 0;
+
+  while(true)
+  {
+    cache_tier_entry_t entry = cache_tier_get(tier, i);
+    uint16_t age = cache_get_age(entry.element_number);
+
+    if(state->is_first || age > state->last_age) // Skip positions already covered by a finer tier
+    {
+      uint16_t position_start = *length;
+      if(!cache_encode_position(buf, length, max_length, &entry.position, state->is_first ? NULL : &state->previous_position))
+      {
+        *length = position_start; // Drop incomplete position and older ones of this tier
+        return false;
+      }
+
+      state->previous_position = entry.position;
+      state->last_age = age;
+      state->is_first = false;
+    }
+
+    if(i == size - 1) return true;
+    i = (size - 1 - i > stride) ? i + stride : size - 1;
+  }
+}
+
+// Flush dirty positions before esp_restart(), e.g. from camera_panic()
+static void cache_shutdown_handler(void)
+{
+  cache_store();
+}
 
 // Exported functions
-void cache_begin(Preferences* p_pref)
+void cache_begin(void)
+{
+  if(cache_mutex == NULL) cache_mutex = xSemaphoreCreateRecursiveMutex();
+
+  p_cache_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, CACHE_LOG_PARTITION);
+
+  // One sector is always being erased, the others must hold all rings
+  uint16_t log_entries_needed = CACHE_LENGTH + CACHE_TIER1_LENGTH + CACHE_TIER2_LENGTH + CACHE_TIER3_LENGTH;
+  if(p_cache_partition == NULL || cache_log_sector_count() < 3 || (cache_log_sector_count() - 2) * (SPI_FLASH_SEC_SIZE / sizeof(cache_log_entry_t)) < log_entries_needed)
+  {
+    DEBUG_PRINTLN("[CACHE] No log partition, RAM only");
+    p_cache_partition = NULL;
+    return;
+  }
+
+  cache_lock();
+  cache_log_rebuild();
+  cache_unlock();
+
+  esp_register_shutdown_handler(cache_shutdown_handler);
+}
+
+void cache_lock(void)
 {
-  p_cache_preferences = p_pref;
+  xSemaphoreTakeRecursive(cache_mutex, portMAX_DELAY);
 }
 
-char* cache_get(uint16_t* index)
+void cache_unlock(void)
 {
-  p_cache_preferences->getBytes("c_buf", cache_buf, CACHE_LENGTH); // Read cache from NVS
-  element_number = p_cache_preferences->getUShort("c_id", 0); // Read cache index from NVS
+  xSemaphoreGiveRecursive(cache_mutex);
+}
+
+// Positions pushed but not yet stored in the log
+bool cache_is_dirty(void)
+{
+  bool is_dirty = stored_element_number != element_number;
 
-  DEBUG_PRINT("[CACHE] READ: ");
-  DEBUG_PRINTLN(cache_buf);
+  for(uint8_t tier = 1; tier < CACHE_TIER_COUNT; tier++) if(cache_tiers[tier].unstored > 0) is_dirty = true;
 
-  *index = element_number;
-  return cache_buf;
+  return is_dirty;
 }
 
+// Append positions pushed since last store to the log
 void cache_store(void)
 {
-  p_cache_preferences->putBytes("c_buf", cache_buf, CACHE_LENGTH); // Write cache to NVS
-  p_cache_preferences->putUShort("c_id", element_number); // Write cache index to NVS
+  if(p_cache_partition == NULL) return;
+
+  cache_lock();
+
+  // Positions already shifted out of the ring are lost
+  if(element_number - stored_element_number > CACHE_LENGTH) stored_element_number = element_number - CACHE_LENGTH;
+
+  while(stored_element_number != element_number)
+  {
+    stored_element_number++;
+    cache_log_append(0, stored_element_number, cache_ring[(stored_element_number - 1) % CACHE_LENGTH]);
+  }
+
+  for(uint8_t tier = 1; tier < CACHE_TIER_COUNT; tier++)
+  {
+    while(cache_tiers[tier].unstored > 0)
+    {
+      cache_tiers[tier].unstored--;
+      cache_tier_entry_t entry = cache_tier_get(tier, cache_tiers[tier].unstored);
+      cache_log_append(tier, entry.element_number, entry.position);
+    }
+  }
+
+  cache_unlock();
 }
 
-u_int16_t cache_push(char c)
+// Erase the oldest log sector ahead of time, so storing never has to wait for a sector erase
+void cache_compact(void)
 {
-  if(element_number >= CACHE_LENGTH)
+  if(p_cache_partition == NULL) return;
+
+  cache_lock();
+  if(cache_log_erase_sector >= 0) cache_log_erase(cache_log_erase_sector);
+  cache_unlock();
+}
+
+uint16_t cache_push(cache_position_t position)
+{
+  cache_lock();
+
+  cache_ring[cache_head] = position; // Overwrite oldest position if cache full
+
+  cache_head++;
+  if(cache_head >= CACHE_LENGTH) cache_head = 0;
+
+  element_number++; // Marks cache dirty until stored
+  uint16_t number = element_number;
+
+  // Copy position into coarse tiers, if their interval passed
+  cache_tier_entry_t entry = {position, number};
+  for(uint8_t tier = 1; tier < CACHE_TIER_COUNT; tier++)
   {
-    memmove(&cache_buf[0], &cache_buf[1], CACHE_LENGTH*sizeof(char)); // Shift all elements left by one
-    cache_buf[CACHE_LENGTH-1] = c; // Append new element to the end
+    if(cache_tiers[tier].size == 0 || (uint16_t) (position.time - cache_tier_get(tier, 0).position.time) >= cache_tiers[tier].interval)
+    {
+      cache_tier_push(tier, entry);
+    }
   }
+
+  cache_unlock();
+
+  return number;
+}
+
+// Overwrite the newest position, e.g. to move the end point of a straight track segment
+void cache_replace_newest(cache_position_t position)
+{
+  cache_lock();
+
+  if(element_number == 0) cache_push(position);
   else
   {
-    cache_buf[element_number] = c; // Append new element at index
+    cache_ring[(cache_head + CACHE_LENGTH - 1) % CACHE_LENGTH] = position;
+    if(stored_element_number == element_number) stored_element_number--; // Append newest position to the log again
   }
-  element_number++;
 
+  cache_unlock();
+}
+
+// Number of positions pushed since start of flight
+uint16_t cache_get_count(void)
+{
+  return element_number;
+}
+
+// Number of positions currently held in the cache
+uint16_t cache_get_size(void)
+{
+  if(element_number >= CACHE_LENGTH) return CACHE_LENGTH;
   return element_number;
-}
\ No newline at end of file
+}
+
+// Hold cache_lock() while iterating, if other tasks push to the cache
+void cache_iterator_begin(cache_iterator_t* iterator)
+{
+  iterator->index = cache_head;
+  iterator->remaining = cache_get_size();
+}
+
+bool cache_iterator_next(cache_iterator_t* iterator, cache_position_t* position)
+{
+  if(iterator->remaining == 0) return false;
+
+  if(iterator->index == 0) iterator->index = CACHE_LENGTH; // Wrap around to the end of the ring
+  iterator->index--;
+  iterator->remaining--;
+
+  *position = cache_ring[iterator->index];
+  return true;
+}
+
+// Encode the newest positions of all tiers that fit (newest first) followed by end flag and element number into buf
+uint16_t cache_serialize(char* buf, uint16_t buf_length)
+{
+  uint16_t max_length = buf_length - 4; // Keep space for end flag, element number and null termination
+  uint16_t length = 0;
+
+  cache_lock();
+
+  buf[length++] = '{'; // Add start flag
+
+  cache_frame_state_t state;
+  state.is_first = true;
+  state.last_age = 0;
+  uint16_t frame_start = length;
+  uint8_t share_sum = 0; // Shares of this and all finer tiers, so unused space moves on
+
+  for(uint8_t tier = 0; tier < CACHE_TIER_COUNT; tier++)
+  {
+    share_sum += cache_frame_tier_shares[tier];
+
+    uint16_t size = cache_tier_get_size(tier);
+    if(size == 0) continue;
+
+    // Limit this tier to its share of the frame, if a coarser tier reaches further back in time
+    bool reaches_start = true;
+    uint16_t oldest_age = cache_get_age(cache_tier_get(tier, size - 1).element_number);
+    for(uint8_t coarser_tier = tier + 1; coarser_tier < CACHE_TIER_COUNT; coarser_tier++)
+    {
+      uint16_t coarser_size = cache_tier_get_size(coarser_tier);
+      if(coarser_size > 0 && cache_get_age(cache_tier_get(coarser_tier, coarser_size - 1).element_number) > oldest_age) reaches_start = false;
+    }
+
+    if(!reaches_start)
+    {
+      cache_encode_tier(buf, &length, frame_start + (uint32_t) (max_length - frame_start) * share_sum / 100, tier, 1, &state); // Newest positions, older ones follow from the coarser tier
+      continue;
+    }
+
+    // Oldest tier, thin it out until it reaches back to the start of the flight
+    uint16_t tier_start = length;
+    cache_frame_state_t tier_state;
+    uint16_t stride = 1;
+    do
+    {
+      length = tier_start;
+      tier_state = state;
+    } while(!cache_encode_tier(buf, &length, max_length, tier, stride, &tier_state) && ++stride < size);
+    break;
+  }
+
+  buf[length++] = '|'; // Add end flag
+  buf[length++] = element_number / 90 + 33; // Add ASCII Base91 encoded element number MSB
+  buf[length++] = element_number % 90 + 33; // Add ASCII Base91 encoded element number LSB
+  buf[length] = '\0'; // Add null termination
+
+  cache_unlock();
+
+  return length;
+}
@@ -21,12 +21,52 @@
 #ifndef __CACHE__H__
 #define __CACHE__H__
 
-#include <Preferences.h> // Non-volatile storage
+#include <Arduino.h>
 
+#include "config.h"
+
+#define CACHE_FRAME_BUF_LENGTH 254 // Start flag, encoded positions, end flag, 2 chars element number and null termination must fit into the 256 byte AX.25 info field
+
+#define CACHE_LOG_PARTITION "cache" // Flash partition for the append-only cache log, see partitions.csv
+
+// Cached position
+typedef struct
+{
+  int16_t latitude; // Decimal degrees *100
+  int16_t longitude; // Decimal degrees *100
+  uint16_t altitude; // Altitude in m
+  uint16_t time; // Minutes since 2000-01-01 UTC modulo 2^16, see gps_get_time_minutes()
+} cache_position_t;
+
+// Position of a coarse tier
+typedef struct
+{
+  cache_position_t position;
+  uint16_t element_number; // Element number of the full rate position it was taken from
+} cache_tier_entry_t;
+
+// Iterates cached positions from newest to oldest
+typedef struct
+{
+  uint16_t index;
+  uint16_t remaining;
+} cache_iterator_t;
 
 // Exported functions
-void cache_begin(Preferences* p_pref);
-char* cache_get(uint16_t* index);
+void cache_begin(void);
+void cache_lock(void);
+void cache_unlock(void);
+bool cache_is_dirty(void);
 void cache_store(void);
-u_int16_t cache_push(char c);
+void cache_compact(void);
+uint16_t cache_push(cache_position_t position);
+void cache_replace_newest(cache_position_t position);
+
+uint16_t cache_get_count(void);
+uint16_t cache_get_size(void);
+
+void cache_iterator_begin(cache_iterator_t* iterator);
+bool cache_iterator_next(cache_iterator_t* iterator, cache_position_t* position);
+
+uint16_t cache_serialize(char* buf, uint16_t buf_length);
 #endif
@@ -25,20 +25,276 @@
 #include "esp_camera.h"
 #include "globals.h"
 #include "pins.h"
+#include "image_store.h"
+#include "fountain.h"
 
 #include "../lib/ssdv/ssdv.h"
-#include "../lib/base64/base64.hpp"
 #include <Preferences.h> // Non-volatile storage
 
+#define CAMERA_STATE_OFF 0 // Camera powered off, driver not initialized
+#define CAMERA_STATE_STANDBY 1 // Sensor in standby, driver and frame buffer kept
+#define CAMERA_STATE_ACTIVE 2
+
+#define CAMERA_PROFILE_COUNT (sizeof(camera_profiles) / sizeof(camera_profiles[0]))
+#define CAMERA_ROI_COUNT (sizeof(camera_rois) / sizeof(camera_rois[0]))
+
+typedef struct
+{
+  framesize_t framesize;
+  uint8_t jpeg_quality; // OV2640 JPEG quality 0-63
+  uint8_t ssdv_quality; // SSDV quality 0-7
+  uint16_t packets; // Expected SSDV NOFEC packets of the full image, FEC independent and updated after every image
+} camera_profile_t;
+
+// Region of interest in percent of the sensor field
+typedef struct
+{
+  uint8_t left;
+  uint8_t top;
+  uint8_t right;
+  uint8_t bottom;
+} camera_roi_t;
+
+#define OV2640_REG_COM2 0x109 // Sensor bank register COM2, bank select in bit 8 as used by sensor_t set_reg()
+#define OV2640_COM2_STANDBY 0x10
+#define OV2640_REG_GAIN 0x100 // AGC gain
+#define OV2640_REG_REG04 0x104 // AEC[1:0]
+#define OV2640_REG_AEC 0x110 // AEC[9:2]
+#define OV2640_REG_REG45 0x145 // AEC[15:10]
+#define OV2640_WINDOW_MODE_SVGA 1 // set_res_raw() sensor mode with an 800x600 field, scaled down to the output size
+#define OV2640_WINDOW_WIDTH 800
+#define OV2640_WINDOW_HEIGHT 600
+
 // Module globals
 Preferences* p_cam_preferences;
 camera_fb_t *ov2640_frame_buf; // OV2640 camera frame buffer
+camera_fb_t *ov2640_thumbnail_buf = NULL; // OV2640 thumbnail frame buffer, sent before the full image
+camera_fb_t *p_ssdv_frame_buf = NULL; // Frame buffer currently fed into SSDV
 camera_config_t ov2640_config; // OV2640 camera settings
 
 ssdv_t ssdv;
 uint8_t packet_img_buf[IMAGE_PACKET_LENGTH]; // RAW image packet buffer
-uint8_t packet_img_base64_buf[IMAGE_PACKET_BASE64_LENGTH]; // BASE64 image packet buffer
-uint16_t img_buf_index = 0; // Index for iterating thru the image buffer
+char packet_img_base91_buf[IMAGE_PACKET_BASE91_LENGTH]; // basE91 image packet text
+size_t img_buf_index = 0; // Frame buffer bytes already handed to SSDV
+uint16_t img_id_counter = 0; // SSDV image ID of the next image
+uint8_t img_packet_error_rate = IMAGE_PACKET_ERROR_RATE; // Expected packet error rate in percent for the next image
+uint8_t camera_state = CAMERA_STATE_OFF;
+uint32_t camera_wake_time = 0; // millis() at last camera wake
+uint16_t camera_last_exposure = 0; // AEC exposure at last convergence check
+uint8_t camera_last_gain = 0; // AGC gain at last convergence check
+uint8_t camera_stable_samples = 0; // Convergence checks in a row without significant change
+
+#ifdef IMAGE_ADAPTIVE_ENABLE
+  camera_profile_t camera_profiles[] = IMAGE_PROFILES;
+#else
+  camera_profile_t camera_profiles[] = {{OV2640_FRAMESIZE, OV2640_JPEG_QUALITY, SSDV_JPEG_QUALITY, 0}};
+#endif
+uint8_t camera_profile = CAMERA_PROFILE_COUNT - 1; // Frame size and quality of the next capture
+#ifdef OV2640_ROI_ENABLE
+  const camera_roi_t camera_rois[] = OV2640_ROI_WINDOWS;
+#endif
+uint16_t img_full_packets = 0; // SSDV packets of the full image encoded so far
+uint8_t img_ssdv_type = SSDV_TYPE_NOFEC; // SSDV packet type of the image being encoded
+bool img_is_cropped = false; // Full image is a ROI crop, its packet count says nothing about the profile
+bool img_is_encoding = false; // Capture held in the frame buffers is being encoded into the image store
+uint16_t img_thumbnail_packets = 0; // Thumbnail packets encoded into the image store
+uint32_t img_encode_ms = 0; // Time spent encoding the capture into the image store
+
+// Module functions
+
+// Cheap image quality score, higher is better
+static uint32_t camera_get_image_score(camera_fb_t* p_frame, uint32_t pixels)
+{
+  DEBUG_PRINT("[OV2640] Frame size: ");
+  DEBUG_PRINTLN(p_frame->len);
+
+  // JPEG bytes per pixel as proxy for image detail, comparable across crops. Blurred frames, black sky and sun glare
+  // compress better. Taken from the frame itself, sensor registers may already describe a later frame.
+  return (uint32_t) p_frame->len * 1024 / pixels;
+}
+
+// Get SSDV image ID for the next image
+static uint16_t camera_take_image_id()
+{
+  uint16_t image_id = img_id_counter;
+
+  #if IMAGE_ID_COUNTER == IMAGE_ID_RUNNING
+    img_id_counter++; // Increment image ID counter
+    if(img_id_counter % IMAGE_ID_NVS_INTERVAL == 0) p_cam_preferences->putUInt("img_id", img_id_counter); // Write image ID to NVS only now and then
+  #endif
+
+  return image_id;
+}
+
+// Get SSDV packet type for the next image
+static uint8_t camera_get_ssdv_type()
+{
+  if(camera_is_fountain_coded()) return SSDV_TYPE_NOFEC; // Fountain frames carry NOFEC packets, lost packets are repaired across the image
+
+  #if IMAGE_SSDV_FEC == IMAGE_SSDV_FEC_ON
+    return SSDV_TYPE_NORMAL;
+  #elif IMAGE_SSDV_FEC == IMAGE_SSDV_FEC_AUTO
+    return img_packet_error_rate >= IMAGE_SSDV_FEC_MIN_ERROR_RATE ? SSDV_TYPE_NORMAL : SSDV_TYPE_NOFEC; // Parity only pays off on lossy links
+  #else
+    return SSDV_TYPE_NOFEC;
+  #endif
+}
+
+// Start SSDV encoding of a frame buffer
+static void camera_ssdv_begin(camera_fb_t* p_frame, uint16_t image_id)
+{
+  uint8_t ssdv_type = camera_get_ssdv_type();
+
+  DEBUG_PRINT("[SSDV] Begin IMG/FEC/payload: ");
+  DEBUG_PRINT(image_id);
+  DEBUG_PRINT("/");
+  DEBUG_PRINT(ssdv_type == SSDV_TYPE_NORMAL);
+  DEBUG_PRINT("/");
+  DEBUG_PRINTLN(IMAGE_PACKET_PAYLOAD_LENGTH(ssdv_type == SSDV_TYPE_NORMAL));
+
+  p_ssdv_frame_buf = p_frame;
+  img_buf_index = 0;
+  img_full_packets = 0;
+  img_ssdv_type = ssdv_type;
+
+  ssdv_enc_init(&ssdv, ssdv_type, (char*) "", image_id, camera_profiles[camera_profile].ssdv_quality, IMAGE_PACKET_LENGTH); // Set SSDV callsign to "" -> will be striped off anyway
+  ssdv_enc_set_buffer(&ssdv, packet_img_buf);
+}
+
+// Return frame buffers to the camera driver
+static void camera_release_frames()
+{
+  esp_camera_return_all();
+
+  ov2640_frame_buf = NULL;
+  ov2640_thumbnail_buf = NULL;
+  p_ssdv_frame_buf = NULL;
+}
+
+// Encode next SSDV packet of the current capture into packet_img_buf, continues with the full image after the thumbnail
+static uint8_t camera_encode_packet()
+{
+  uint8_t ssdv_status = 0;
+
+  while((ssdv_status = ssdv_enc_get_packet(&ssdv)) == SSDV_FEED_ME)
+  {
+    size_t remaining_length = p_ssdv_frame_buf->len - img_buf_index;
+    if(remaining_length == 0) // JPEG without end of image marker
+    {
+      DEBUG_PRINTLN("[SSDV] Truncated IMG");
+      ssdv_status = SSDV_EOI;
+      break;
+    }
+
+    // Hand the rest of the frame buffer over in one go, SSDV reads it in place and keeps its own read position
+    ssdv_enc_feed(&ssdv, &p_ssdv_frame_buf->buf[img_buf_index], remaining_length);
+    img_buf_index = p_ssdv_frame_buf->len;
+  }
+
+  if(p_ssdv_frame_buf == ov2640_frame_buf && !img_is_cropped) // Learn the packet count of the profile from the full view
+  {
+    if(ssdv_status == SSDV_OK) img_full_packets++;
+    else if(ssdv_status == SSDV_EOI)
+    {
+      uint16_t nofec_packets = ((uint32_t) img_full_packets * IMAGE_PACKET_PAYLOAD_LENGTH(img_ssdv_type == SSDV_TYPE_NORMAL) + IMAGE_PACKET_PAYLOAD_LENGTH(false) - 1) / IMAGE_PACKET_PAYLOAD_LENGTH(false); // Same image in NOFEC packets
+      camera_profiles[camera_profile].packets = (camera_profiles[camera_profile].packets + nofec_packets + 1) / 2;
+    }
+  }
+
+  if(ssdv_status == SSDV_EOI && ov2640_thumbnail_buf != NULL && p_ssdv_frame_buf == ov2640_thumbnail_buf) // Continue with the full image
+  {
+    DEBUG_PRINTLN("[SSDV] End of thumbnail");
+    esp_camera_fb_return(ov2640_thumbnail_buf);
+    ov2640_thumbnail_buf = NULL;
+
+    camera_ssdv_begin(ov2640_frame_buf, camera_take_image_id());
+    return camera_encode_packet();
+  }
+
+  return ssdv_status;
+}
+
+// Start encoding the capture into the image store, camera_encode_for_ms() continues in slices
+static void camera_store_begin()
+{
+  image_store_new_image();
+
+  img_is_encoding = true;
+  img_thumbnail_packets = 0;
+  img_encode_ms = 0;
+}
+
+// Archive the encoded image and release the frame buffers
+static void camera_store_end()
+{
+  img_is_encoding = false;
+
+  image_store_close_image(img_thumbnail_packets); // Archive image for retransmission
+  camera_release_frames();
+
+  DEBUG_PRINT("[SSDV] Stored packets/ms/us per packet: ");
+  DEBUG_PRINT(image_store_get_count());
+  DEBUG_PRINT("/");
+  DEBUG_PRINT(img_encode_ms);
+  DEBUG_PRINT("/");
+  DEBUG_PRINTLN(image_store_get_count() > 0 ? img_encode_ms * 1000 / image_store_get_count() : 0);
+}
+
+#ifdef OV2640_ROI_ENABLE
+  // Crop the sensor field to a ROI, the output keeps the scale of the profile frame size in whole MCUs, returns output pixels
+  static uint32_t camera_set_roi(uint8_t roi)
+  {
+    sensor_t* p_sensor = esp_camera_sensor_get();
+    const camera_roi_t* p_roi = &camera_rois[roi];
+    framesize_t framesize = camera_profiles[camera_profile].framesize;
+
+    uint16_t window_width = (uint32_t) OV2640_WINDOW_WIDTH * (p_roi->right - p_roi->left) / 100;
+    uint16_t window_height = (uint32_t) OV2640_WINDOW_HEIGHT * (p_roi->bottom - p_roi->top) / 100;
+    uint16_t output_width = (uint32_t) resolution[framesize].width * window_width / OV2640_WINDOW_WIDTH / 16 * 16;
+    uint16_t output_height = (uint32_t) resolution[framesize].height * window_height / OV2640_WINDOW_HEIGHT / 16 * 16;
+
+    p_sensor->set_res_raw(p_sensor, OV2640_WINDOW_MODE_SVGA, 0, 0, 0, OV2640_WINDOW_WIDTH * p_roi->left / 100, OV2640_WINDOW_HEIGHT * p_roi->top / 100, window_width, window_height, output_width, output_height, false, false);
+
+    camera_fb_t* p_frame = esp_camera_fb_get(); // Drop frame captured while switching the window
+    if(p_frame != NULL) esp_camera_fb_return(p_frame);
+
+    DEBUG_PRINT("[OV2640] ROI/output: ");
+    DEBUG_PRINT(roi);
+    DEBUG_PRINT("/");
+    DEBUG_PRINT(output_width);
+    DEBUG_PRINT("x");
+    DEBUG_PRINTLN(output_height);
+
+    return (uint32_t) output_width * output_height; // Frame buffer width and height keep the profile frame size
+  }
+#endif
+
+#ifdef IMAGE_THUMBNAIL_ENABLE
+  // Capture small frame right after the full one, the full frame buffer stays held
+  static camera_fb_t* camera_capture_thumbnail()
+  {
+    sensor_t* p_sensor = esp_camera_sensor_get();
+
+    p_sensor->set_framesize(p_sensor, OV2640_THUMBNAIL_FRAMESIZE);
+
+    camera_fb_t* p_frame = esp_camera_fb_get(); // Drop frame captured while switching frame size
+    if(p_frame != NULL) esp_camera_fb_return(p_frame);
+    p_frame = esp_camera_fb_get();
+
+    p_sensor->set_framesize(p_sensor, camera_profiles[camera_profile].framesize); // Next capture at full resolution again
+
+    return p_frame;
+  }
+#endif
+
+// Set frame size and JPEG quality of the chosen profile, the frame buffers are sized for OV2640_FRAMESIZE
+static void camera_apply_profile()
+{
+  sensor_t* p_sensor = esp_camera_sensor_get();
+
+  p_sensor->set_framesize(p_sensor, camera_profiles[camera_profile].framesize);
+  p_sensor->set_quality(p_sensor, camera_profiles[camera_profile].jpeg_quality);
+}
 
 // Exported functions
 void camera_begin(Preferences* p_pref)
@@ -85,11 +341,26 @@ void camera_init()
   ov2640_config.frame_size = OV2640_FRAMESIZE;
 
   ov2640_config.jpeg_quality = OV2640_JPEG_QUALITY;
-  ov2640_config.fb_count = 1;
+  #ifdef IMAGE_THUMBNAIL_ENABLE
+    ov2640_config.fb_count = 2; // Keep full frame while capturing the thumbnail
+  #else
+    ov2640_config.fb_count = OV2640_BEST_OF_FRAMES > 1 ? 2 : 1; // Keep best frame while capturing the next one
+  #endif
+  ov2640_config.grab_mode = ov2640_config.fb_count > 1 ? CAMERA_GRAB_LATEST : CAMERA_GRAB_WHEN_EMPTY;
   ov2640_config.fb_location = CAMERA_FB_IN_DRAM;
 
   // Initialize OV2640 camera
   esp_err_t ov2640_initialization_error = esp_camera_init(&ov2640_config);
+  if(ov2640_initialization_error != ESP_OK && ov2640_config.fb_count > 1) // No PSRAM, DRAM may not hold two frame buffers
+  {
+    DEBUG_PRINT("[OV2640] Init err, retry with one frame buffer: ");
+    DEBUG_PRINTLN(ov2640_initialization_error);
+
+    // esp_camera_init() releases everything on failure, best of frames and thumbnail are skipped with one buffer
+    ov2640_config.fb_count = 1;
+    ov2640_config.grab_mode = CAMERA_GRAB_WHEN_EMPTY;
+    ov2640_initialization_error = esp_camera_init(&ov2640_config);
+  }
   if (ov2640_initialization_error != ESP_OK) 
   {
     MCU_SET_FREQ_NORMAL;
@@ -103,54 +374,312 @@ void camera_init()
   MCU_SET_FREQ_NORMAL; // Clock MCU down to save power
 }
 
-void camera_capture_image()
+// Get image ID from NVS after power on, the RTC state block keeps it across software restarts
+void camera_load_image_id()
 {
-  uint16_t img_id_counter = p_cam_preferences->getUInt("img_id", 0); // Get image ID from NVS
+  img_id_counter = p_cam_preferences->getUInt("img_id", 0);
 
-  img_buf_index = 0;
-  
-  DEBUG_PRINT("[OV2640] Capture IMG: ");
-  DEBUG_PRINTLN(img_id_counter);
+  #if IMAGE_ID_COUNTER == IMAGE_ID_RUNNING
+    img_id_counter += IMAGE_ID_NVS_INTERVAL; // IDs up to the next NVS write may have been used already
+    p_cam_preferences->putUInt("img_id", img_id_counter);
+  #endif
+}
+
+void camera_set_image_id(uint16_t image_id)
+{
+  img_id_counter = image_id;
+}
+
+uint16_t camera_get_image_id()
+{
+  return img_id_counter;
+}
+
+// Choose the largest profile whose expected packet count fits the budget, call after camera_set_packet_error_rate() and before camera_wake()
+void camera_set_packet_budget(uint16_t packet_budget)
+{
+  bool is_fec = camera_get_ssdv_type() == SSDV_TYPE_NORMAL;
+
+  camera_profile = 0; // Smallest image if nothing fits
+  for(uint8_t i = CAMERA_PROFILE_COUNT - 1; i > 0; i--)
+  {
+    uint16_t expected_packets = ((uint32_t) camera_profiles[i].packets * IMAGE_PACKET_PAYLOAD_LENGTH(false) + IMAGE_PACKET_PAYLOAD_LENGTH(is_fec) - 1) / IMAGE_PACKET_PAYLOAD_LENGTH(is_fec); // FEC packets carry less payload
+    if(expected_packets <= packet_budget)
+    {
+      camera_profile = i;
+      break;
+    }
+  }
+
+  // An image over budget raised the estimate of the larger profile, let it shrink again so the profile is tried once more
+  if(camera_profile < CAMERA_PROFILE_COUNT - 1) camera_profiles[camera_profile + 1].packets -= (uint32_t) camera_profiles[camera_profile + 1].packets * IMAGE_PROFILE_DECAY_PERCENT / 100;
+
+  DEBUG_PRINT("[OV2640] Budget/profile/expected NOFEC packets: ");
+  DEBUG_PRINT(packet_budget);
+  DEBUG_PRINT("/");
+  DEBUG_PRINT(camera_profile);
+  DEBUG_PRINT("/");
+  DEBUG_PRINTLN(camera_profiles[camera_profile].packets);
+}
+
+// Set expected packet error rate in percent, e.g. from igate coverage or a ground report, IMAGE_SSDV_FEC_AUTO adds Reed-Solomon to lossy images
+void camera_set_packet_error_rate(uint8_t packet_error_rate)
+{
+  img_packet_error_rate = packet_error_rate;
+}
+
+// Power camera up from off or standby, returns time in ms auto exposure needs to settle
+uint32_t camera_wake()
+{
+  camera_wake_time = millis();
+  camera_stable_samples = 0;
+  camera_last_exposure = 0;
+  camera_last_gain = 0;
+
+  if(camera_state == CAMERA_STATE_STANDBY) // Warm start
+  {
+    DEBUG_PRINTLN("[OV2640] Wake from standby");
+    esp_camera_sensor_get()->set_reg(esp_camera_sensor_get(), OV2640_REG_COM2, OV2640_COM2_STANDBY, 0);
+    camera_state = CAMERA_STATE_ACTIVE;
+    camera_apply_profile();
+
+    return OV2640_AE_SETTLE_WARM_MS;
+  }
+
+  if(camera_state == CAMERA_STATE_OFF) // Cold start
+  {
+    camera_init();
+    camera_state = CAMERA_STATE_ACTIVE;
+  }
+
+  camera_apply_profile();
+
+  return OV2640_AE_SETTLE_COLD_MS;
+}
+
+// Power camera down according to OV2640_POWER_MODE, the captured frame buffer stays valid in standby
+void camera_sleep()
+{
+  #if OV2640_POWER_MODE == OV2640_POWER_WARM
+    esp_camera_sensor_get()->set_reg(esp_camera_sensor_get(), OV2640_REG_COM2, OV2640_COM2_STANDBY, OV2640_COM2_STANDBY);
+    camera_state = CAMERA_STATE_STANDBY;
+  #else
+    while(img_is_encoding) camera_encode_for_ms(IMAGE_ENCODE_SLICE_MS); // Frame buffers are freed with the driver
+    camera_deinit();
+    camera_disable();
+    camera_state = CAMERA_STATE_OFF;
+  #endif
+
+  // Camera on time is proportional to camera energy per image, compare cold and warm mode with it
+  DEBUG_PRINT("[OV2640] On time ms: ");
+  DEBUG_PRINTLN(millis() - camera_wake_time);
+}
+
+// Check if auto exposure and gain converged, call about once per frame after camera_wake()
+bool camera_exposure_is_stable()
+{
+  sensor_t* p_sensor = esp_camera_sensor_get();
+
+  uint16_t exposure = (p_sensor->get_reg(p_sensor, OV2640_REG_REG45, 0x3F) << 10) | (p_sensor->get_reg(p_sensor, OV2640_REG_AEC, 0xFF) << 2) | p_sensor->get_reg(p_sensor, OV2640_REG_REG04, 0x03);
+  uint8_t gain = p_sensor->get_reg(p_sensor, OV2640_REG_GAIN, 0xFF);
+
+  bool exposure_is_stable = abs(exposure - camera_last_exposure) * 100 <= camera_last_exposure * OV2640_AE_STABLE_TOLERANCE;
+  bool gain_is_stable = abs(gain - camera_last_gain) * 100 <= camera_last_gain * OV2640_AE_STABLE_TOLERANCE + 100; // Allow one step at low gain
+
+  if(exposure_is_stable && gain_is_stable) camera_stable_samples++;
+  else camera_stable_samples = 0;
+
+  camera_last_exposure = exposure;
+  camera_last_gain = gain;
+
+  DEBUG_PRINT("[OV2640] AEC/AGC: ");
+  DEBUG_PRINT(exposure);
+  DEBUG_PRINT("/");
+  DEBUG_PRINTLN(gain);
+
+  return camera_stable_samples >= OV2640_AE_STABLE_SAMPLES;
+}
+
+void camera_capture_image()
+{
+  DEBUG_PRINTLN("[OV2640] Capture IMG");
 
   MCU_SET_FREQ_CAMERA;
 
   // Capture image
-  ov2640_frame_buf = esp_camera_fb_get();
+  camera_fb_t* p_stale_frame = esp_camera_fb_get(); // Drop frame grabbed by the driver while auto exposure settled
+  if(p_stale_frame != NULL) esp_camera_fb_return(p_stale_frame);
+
+  // Keep the frame with the best score
+  ov2640_frame_buf = NULL;
+  img_is_cropped = false;
+  uint32_t best_score = 0;
+  framesize_t framesize = camera_profiles[camera_profile].framesize;
+  uint32_t full_pixels = (uint32_t) (resolution[framesize].width / 16 * 16) * (resolution[framesize].height / 16 * 16); // Full view in whole MCUs like camera_set_roi()
+  uint32_t pixels = full_pixels;
+  uint8_t frame_count = ov2640_config.fb_count > 1 ? OV2640_BEST_OF_FRAMES : 1; // One frame buffer can not hold the best frame while capturing the next
+  for(uint8_t i = 0; i < frame_count; i++)
+  {
+    #ifdef OV2640_ROI_ENABLE
+      if(i < CAMERA_ROI_COUNT) pixels = camera_set_roi(i); // Each window gets a frame, the crop with the most detail per pixel wins
+    #endif
+
+    camera_fb_t* p_frame = esp_camera_fb_get();
+    if(p_frame == NULL) continue;
+
+    uint32_t score = camera_get_image_score(p_frame, pixels);
+    if(ov2640_frame_buf == NULL || score > best_score)
+    {
+      if(ov2640_frame_buf != NULL) esp_camera_fb_return(ov2640_frame_buf);
+      ov2640_frame_buf = p_frame;
+      best_score = score;
+      img_is_cropped = pixels < full_pixels;
+    }
+    else
+    {
+      esp_camera_fb_return(p_frame);
+    }
+  }
 
-  MCU_SET_FREQ_NORMAL; // Clock MCU down to save power
+  if(ov2640_frame_buf == NULL)
+  {
+    MCU_SET_FREQ_NORMAL;
 
-  // Initialize SSDV
-  ssdv_enc_init(&ssdv, SSDV_TYPE_NOFEC, (char*) "", img_id_counter, SSDV_JPEG_QUALITY, IMAGE_PACKET_LENGTH); // Set SSDV callsign to "" -> will be striped off anyway
-  ssdv_enc_set_buffer(&ssdv, packet_img_buf);
+    DEBUG_PRINTLN("[OV2640] Capture err");
 
-  #if IMAGE_ID_COUNTER == IMAGE_ID_RUNNING
-    img_id_counter++; // Increment image ID counter
-    p_cam_preferences->putUInt("img_id", img_id_counter); // Write image ID to NVS
+    camera_panic();
+  }
+
+  DEBUG_PRINT("[OV2640] Capture latency ms: ");
+  DEBUG_PRINTLN(millis() - camera_wake_time);
+
+  #ifdef IMAGE_THUMBNAIL_ENABLE
+    if(ov2640_config.fb_count > 1) ov2640_thumbnail_buf = camera_capture_thumbnail(); // Needs the second frame buffer
   #endif
+
+  MCU_SET_FREQ_NORMAL; // Clock MCU down to save power
+
+  // Initialize SSDV, a thumbnail is sent first and the full image follows under the next image ID
+  if(ov2640_thumbnail_buf != NULL) camera_ssdv_begin(ov2640_thumbnail_buf, camera_take_image_id());
+  else camera_ssdv_begin(ov2640_frame_buf, camera_take_image_id());
+
+  if(image_store_is_available()) camera_store_begin(); // Encode all packets in slices while waiting between radio packets
+}
+
+#if IMAGE_TRANSPORT == IMAGE_TRANSPORT_FOUNTAIN
+  // Get number of fountain frames sent for the stored image
+  static uint16_t camera_get_fountain_frame_count()
+  {
+    uint16_t source_count = image_store_get_count();
+    if(source_count > FOUNTAIN_MAX_SOURCE_COUNT) source_count = FOUNTAIN_MAX_SOURCE_COUNT; // Same limit as fountain_encode()
+
+    uint32_t frame_count = (uint32_t) source_count * (100 + IMAGE_FOUNTAIN_REPAIR_PERCENT) / 100;
+    if(frame_count > FOUNTAIN_MAX_FRAME_COUNT) frame_count = FOUNTAIN_MAX_FRAME_COUNT; // Sequence numbers must not wrap
+
+    return frame_count;
+  }
+
+  // Get next fountain frame of the stored image into packet_img_base91_buf, the sent count of the store is the sequence number
+  static bool camera_get_fountain_packet()
+  {
+    uint16_t source_count = image_store_get_count();
+    uint16_t fountain_sequence = image_store_get_sent();
+
+    if(source_count == 0 || fountain_sequence >= camera_get_fountain_frame_count())
+    {
+      DEBUG_PRINTLN("[SSDV] End of fountain IMG");
+      camera_end_image();
+
+      return false;
+    }
+
+    MCU_SET_FREQ_CAMERA; // Repair frames combine half of all packets
+    fountain_encode(source_count, fountain_sequence, packet_img_buf);
+    MCU_SET_FREQ_NORMAL; // Clock MCU down to save power
+    image_store_set_sent(fountain_sequence + 1);
+
+    base91_encode(packet_img_buf, FOUNTAIN_FRAME_LENGTH, packet_img_base91_buf);
+
+    return true;
+  }
+#endif
+
+// Encode packets of the capture into the image store for about budget_ms, the frame buffers are released after the last one
+void camera_encode_for_ms(uint32_t budget_ms)
+{
+  if(!img_is_encoding) return;
+
+  uint8_t ssdv_status = SSDV_OK;
+  uint32_t slice_start_ms = millis();
+
+  MCU_SET_FREQ_CAMERA;
+
+  while(millis() - slice_start_ms < budget_ms)
+  {
+    WDT_RESET;
+
+    ssdv_status = camera_encode_packet();
+    if(ssdv_status != SSDV_OK) break;
+
+    if(ov2640_thumbnail_buf != NULL) img_thumbnail_packets++;
+    if(!image_store_push(packet_img_buf))
+    {
+      DEBUG_PRINTLN("[SSDV] Store full");
+      ssdv_status = SSDV_EOI;
+      break;
+    }
+  }
+
+  MCU_SET_FREQ_NORMAL; // Clock MCU down to save power
+  img_encode_ms += millis() - slice_start_ms;
+
+  if(ssdv_status == SSDV_OK) return; // Time is up, continue in the next slice
+
+  if(ssdv_status != SSDV_EOI)
+  {
+    DEBUG_PRINTLN("[SSDV] Error");
+
+    camera_panic();
+  }
+
+  camera_store_end();
+}
+
+// Capture is still being encoded into the image store
+bool camera_is_encoding()
+{
+  return img_is_encoding;
 }
 
 bool camera_get_new_packet()
 {
   DEBUG_PRINTLN("[SSDV] New packet");
 
+  while(img_is_encoding) camera_encode_for_ms(IMAGE_ENCODE_SLICE_MS); // Waiting time was too short to finish the image
+
+  #if IMAGE_TRANSPORT == IMAGE_TRANSPORT_FOUNTAIN
+    if(camera_is_fountain_coded()) return camera_get_fountain_packet();
+  #endif
+
   uint8_t ssdv_status = 0;
 
-  while((ssdv_status = ssdv_enc_get_packet(&ssdv)) == SSDV_FEED_ME)
+  if(p_ssdv_frame_buf == NULL) ssdv_status = image_store_pop(packet_img_buf) ? SSDV_OK : SSDV_EOI; // Encoded at capture
+  else
   {
-    ssdv_enc_feed(&ssdv, &ov2640_frame_buf->buf[img_buf_index], IMAGE_SSDV_FEED_BUF_LENGTH);
+    uint32_t encode_start_ms = millis();
 
-    DEBUG_PRINT("[SSDV] FB index: "); // Print frame buffer index
-    DEBUG_PRINTLN(img_buf_index);
+    MCU_SET_FREQ_CAMERA;
+    ssdv_status = camera_encode_packet();
+    MCU_SET_FREQ_NORMAL; // Clock MCU down to save power
 
-    // Get index to image buffer next time
-    if((img_buf_index + IMAGE_SSDV_FEED_BUF_LENGTH ) < ov2640_frame_buf->len) img_buf_index = img_buf_index + IMAGE_SSDV_FEED_BUF_LENGTH; // IMG buffer end not yet reached
-    else img_buf_index = img_buf_index + (ov2640_frame_buf->len -  img_buf_index); // IMG buffer end reached
+    DEBUG_PRINT("[SSDV] Encode ms: ");
+    DEBUG_PRINTLN(millis() - encode_start_ms);
   }
   
   if(ssdv_status == SSDV_EOI) 
   {
     DEBUG_PRINTLN("[SSDV] End of Image");
-    esp_camera_return_all();
+    camera_end_image();
 
     return false;
   }
@@ -159,8 +688,8 @@ bool camera_get_new_packet()
   {
     DEBUG_PRINTLN("[SSDV] Packet success");
 
-    // Convert image packet to BASE64
-    encode_base64(packet_img_buf + IMAGE_PACKET_SSDV_OFFSET, IMAGE_PACKET_LENGTH - IMAGE_PACKET_SSDV_OFFSET, packet_img_base64_buf); // Strip of sync byte, packet type and callsign from SSDV
+    // Convert image packet to basE91 text
+    base91_encode(packet_img_buf + IMAGE_PACKET_SSDV_OFFSET, IMAGE_PACKET_LENGTH - IMAGE_PACKET_SSDV_OFFSET, packet_img_base91_buf); // Strip of sync byte, packet type and callsign from SSDV
     
     return true;
   }
@@ -174,6 +703,50 @@ bool camera_get_new_packet()
   return false;
 }
 
+bool camera_is_sending_thumbnail()
+{
+  if(img_is_encoding) return true; // Nothing sent yet
+  if(p_ssdv_frame_buf == NULL) return image_store_get_sent() < image_store_get_thumbnail_count(); // Encoded at capture
+
+  return ov2640_thumbnail_buf != NULL && p_ssdv_frame_buf == ov2640_thumbnail_buf;
+}
+
+// Continue the stored image after a restart, returns false if it was sent completely
+bool camera_resume_image()
+{
+  if(!image_store_is_available()) return false; // Frame buffers are lost, images are only kept in the store
+  if(image_store_get_sent() >= IMAGE_STORE_PROGRESS_MARKS) return false; // Progress beyond the marks is not kept, count the image as sent rather than resending its tail forever
+
+  #if IMAGE_TRANSPORT == IMAGE_TRANSPORT_FOUNTAIN
+    if(image_store_get_sent() >= camera_get_fountain_frame_count()) return false;
+  #else
+    if(image_store_get_sent() >= image_store_get_count()) return false;
+  #endif
+
+  DEBUG_PRINT("[SSDV] Resume IMG at packet: ");
+  DEBUG_PRINTLN(image_store_get_sent());
+
+  return true;
+}
+
+// Image packets are fountain coded, if the image was stored at capture
+bool camera_is_fountain_coded()
+{
+  #if IMAGE_TRANSPORT == IMAGE_TRANSPORT_FOUNTAIN
+    return image_store_is_available();
+  #else
+    return false;
+  #endif
+}
+
+// Drop rest of the current image, e.g. to cut the full image short
+void camera_end_image()
+{
+  img_is_encoding = false;
+  camera_release_frames();
+  image_store_drop_image();
+}
+
 void camera_panic()
 {
   DEBUG_PRINTLN("[ESP] Panic RST");
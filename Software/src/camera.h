@@ -27,18 +27,38 @@
 
 #include <Preferences.h> // Non-volatile storage
 
+#include "base91.h"
+
 #define IMAGE_PACKET_SSDV_OFFSET 6 // Strip of sync byte, packet type and callsign from SSDV
-#define IMAGE_PACKET_BASE64_LENGTH ((IMAGE_PACKET_LENGTH - IMAGE_PACKET_SSDV_OFFSET + 2)/3*4)
+#define IMAGE_PACKET_BASE91_LENGTH BASE91_ENCODED_LENGTH(IMAGE_PACKET_LENGTH - IMAGE_PACKET_SSDV_OFFSET) // Fountain frames have the same length
+#define IMAGE_PACKET_FEC_LENGTH 32 // Reed-Solomon parity bytes of SSDV_TYPE_NORMAL, taken from the JPEG payload as the packet length stays fixed
+#define IMAGE_PACKET_PAYLOAD_LENGTH(fec) (IMAGE_PACKET_LENGTH - 15 - 4 - ((fec) ? IMAGE_PACKET_FEC_LENGTH : 0)) // Packet minus SSDV header and CRC
 
-extern uint8_t packet_img_base64_buf[IMAGE_PACKET_BASE64_LENGTH];
+extern char packet_img_base91_buf[IMAGE_PACKET_BASE91_LENGTH];
 
 // Exported functions
 void camera_init();
 void camera_begin(Preferences* p_pref);
 
+uint32_t camera_wake();
+void camera_sleep();
+bool camera_exposure_is_stable();
+
+void camera_load_image_id();
+void camera_set_image_id(uint16_t image_id);
+uint16_t camera_get_image_id();
+void camera_set_packet_error_rate(uint8_t packet_error_rate);
+void camera_set_packet_budget(uint16_t packet_budget);
+
 void camera_capture_image();
 
+void camera_encode_for_ms(uint32_t budget_ms);
+bool camera_is_encoding();
 bool camera_get_new_packet();
+bool camera_resume_image();
+bool camera_is_sending_thumbnail();
+bool camera_is_fountain_coded();
+void camera_end_image();
 
 void camera_enable();
 void camera_disable();
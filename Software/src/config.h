@@ -54,6 +54,23 @@
 
   #define RADIO_PACKET_DELAY  35000  // Radio packet delay in ms
 
+/*
+ * Igate coverage config
+ */
+
+  #define COVERAGE_ENABLE // Adapt packet rate to igate reception likelihood from coverage_grid.h (generate with tools/coverage_grid.py)
+
+  #define COVERAGE_PACKET_DELAY_NONE 140000 // Radio packet delay in ms without igates in range
+  #define COVERAGE_PACKET_DELAY_LOW 70000 // Radio packet delay in ms with few igates in range
+  #define COVERAGE_PACKET_DELAY_HIGH 25000 // Radio packet delay in ms with dense igate coverage, medium coverage uses RADIO_PACKET_DELAY
+
+  #define COVERAGE_PACKET_ERROR_RATE_NONE 40 // Expected packet error rate in percent without igates in range
+  #define COVERAGE_PACKET_ERROR_RATE_LOW 20 // Expected packet error rate in percent with few igates in range
+  #define COVERAGE_PACKET_ERROR_RATE_HIGH 5 // Expected packet error rate in percent with dense igate coverage, medium coverage uses IMAGE_PACKET_ERROR_RATE
+
+  #define COVERAGE_MIN_LEVEL_IMAGE COVERAGE_MEDIUM // Only send image packets with at least this coverage (COVERAGE_NONE, COVERAGE_LOW, COVERAGE_MEDIUM, COVERAGE_HIGH)
+  #define COVERAGE_MIN_LEVEL_CACHE COVERAGE_LOW // Only send cache packets with at least this coverage
+
 /*
  * Radio config
  */
@@ -61,6 +78,7 @@
   // Set SX1278 NF modulation option
   // MOD_DIO2: use SX1278 DIO2 to generate AFSK modulation
   // MOD_F_HOP: use SX1278 fast frequency hopping to generate AFSK modulation (DIO2 not longer needed)
+  // MOD_F_HOP_DDS: use SX1278 fast frequency hopping through a sine table for phase continuous 1200/2200Hz AFSK (check with tools/afsk_dds.py)
   #define SX1278_MOD_OPTION MOD_DIO2
 
   #if SX1278_MOD_OPTION == MOD_DIO2
@@ -71,9 +89,16 @@
     #define SX1278_FREQUENCY_CORRECTION -55800 // Frequency offset in Hz
     #define SX1278_TX_POWER 17  // Tx power in dbm (2-20 dbm)
     #define SX1278_DEVIATION 3000 // FSK deviation in Hz
+  #elif SX1278_MOD_OPTION == MOD_F_HOP_DDS
+    #define SX1278_FREQUENCY_CORRECTION -55800 // Frequency offset in Hz
+    #define SX1278_TX_POWER 17  // Tx power in dbm (2-20 dbm)
+    #define SX1278_DEVIATION 3000 // Peak FM deviation of the audio tones in Hz
+    #define SX1278_DDS_SAMPLE_RATE 9600 // Frequency updates per second, multiple of 1200 baud
   #endif
 
   #define SX1278_CRYSTAL_FREQ 32000000 // Crystal frequency in Hz
+  #define SX1278_SPI_CLOCK 8000000 // SPI clock in Hz, SX1278 allows up to 10 MHz
+  #define SX1278_EDGE_TIMING EDGE_TIMING_OFF // EDGE_TIMING_MEASURE timestamps every modulation edge and prints the timing error of each packet to debug serial, for tuning only
 
 /*
  * APRS config
@@ -113,7 +138,7 @@
     #define APRS_2400_SPACE_DELAY 206 // Send twice 2400Hz space for ~417us each, so theoretical a delay between state changes of ~208us
   #elif SX1278_MOD_OPTION == MOD_F_HOP
     #define APRS_1200_MARK_DELAY 390 // Send 1200Hz mark for ~833us, so theoretical a delay between state changes of ~417us
-    #define APRS_2400_MARK_DELAY 195 // Send twice 2400Hz mark for ~417us each, so theoretical a delay between state changes of ~208s
+    #define APRS_2400_SPACE_DELAY 195 // Send twice 2400Hz space for ~417us each, so theoretical a delay between state changes of ~208us
   #endif
 
   #define APRS_COMMENT_BUF_SIZE 150
@@ -137,14 +162,53 @@
 
   #define OV2640_JPEG_QUALITY 5 // 0-63 -> smaller number means higher image quality
 
+  #define OV2640_POWER_MODE OV2640_POWER_WARM // OV2640_POWER_COLD powers camera off between images | OV2640_POWER_WARM keeps it initialized in sensor standby
+  #define OV2640_AE_SETTLE_COLD_MS 2000 // Max auto exposure settle time after power on in ms
+  #define OV2640_AE_SETTLE_WARM_MS 500 // Max auto exposure settle time after standby in ms, exposure starts from the last image
+  #define OV2640_AE_POLL_MS 150 // Interval to check exposure and gain for convergence in ms, about one VGA frame
+  #define OV2640_AE_STABLE_SAMPLES 3 // Capture once exposure and gain stayed stable for X checks in a row
+  #define OV2640_AE_STABLE_TOLERANCE 6 // Max change of exposure and gain between checks counted as stable in percent
+
+  #define OV2640_BEST_OF_FRAMES 3 // Capture X frames and send the one with the best score, more than 1 needs a second frame buffer (width*height/5 bytes DRAM), without it only one frame is captured
+
+  #define OV2640_ROI_ENABLE // Capture the best of frames through the ROI windows below in turn (one window per frame, see OV2640_BEST_OF_FRAMES), a crop keeps the angular resolution with fewer MCUs to send
+  #define OV2640_ROI_WINDOWS {{0, 0, 100, 100}, {0, 40, 100, 100}, {20, 20, 80, 80}} // Left, top, right, bottom in percent of the sensor field, the first should be the full view
+
   #define SSDV_JPEG_QUALITY 3 // 0-7 -> higher number means higher image quality
 
   #define IMAGE_PACKET_LENGTH 195
 
-  #define IMAGE_SSDV_FEED_BUF_LENGTH 128
+  #define IMAGE_SSDV_FEC IMAGE_SSDV_FEC_AUTO // IMAGE_SSDV_FEC_OFF sends SSDV NOFEC packets | IMAGE_SSDV_FEC_ON fills 32 bytes of each packet with Reed-Solomon parity | IMAGE_SSDV_FEC_AUTO chooses per image from the expected packet error rate
+  #define IMAGE_SSDV_FEC_MIN_ERROR_RATE 10 // IMAGE_SSDV_FEC_AUTO uses Reed-Solomon from this expected packet error rate in percent, with COVERAGE_ENABLE images are only sent from COVERAGE_MIN_LEVEL_IMAGE up, so compare with the rates of those levels (default: FEC at medium, none at high coverage)
+  #define IMAGE_PACKET_ERROR_RATE 10 // Expected image packet error rate in percent, COVERAGE_ENABLE estimates it from the igate coverage instead
 
   #define IMAGE_APRS_SOURCE_SSID 7
 
+  #define IMAGE_PREENCODE_ENABLE // Encode all SSDV packets into the ssdv flash partition right after capture and release the frame buffers
+  #define IMAGE_ARCHIVE_IMAGES 4 // Number of captures kept in the ssdv flash partition for retransmission
+  #define IMAGE_CAROUSEL_INTERVAL 4 // Every X-th image packet retransmits a packet of an archived capture (0 disables)
+  #define IMAGE_ENCODE_SLICE_MS 100 // Encode stored packets in slices of X ms while waiting between radio packets
+  #define IMAGE_ENCODE_GPS_MS 20 // Process GPS for X ms between encoding slices
+
+  #define IMAGE_TRANSPORT IMAGE_TRANSPORT_SSDV // IMAGE_TRANSPORT_SSDV sends SSDV packets | IMAGE_TRANSPORT_FOUNTAIN sends fountain coded SSDV packets (needs IMAGE_PREENCODE_ENABLE, decode with tools/fountain_decode.py)
+  #define IMAGE_FOUNTAIN_REPAIR_PERCENT 30 // Repair frames sent after the source frames in percent of the SSDV packet count
+  #define IMAGE_FOUNTAIN_APRS_SOURCE_SSID 6
+  #define IMAGE_THUMBNAIL_ENABLE // Send a thumbnail of each capture first, the full image follows under the next image ID
+  #define OV2640_THUMBNAIL_FRAMESIZE FRAMESIZE_QQVGA // Thumbnail frame size, see OV2640_FRAMESIZE
+  #define IMAGE_FULL_MIN_SOLAR_VOLTAGE 0 // Below this solar voltage reading only thumbnails are sent (0 always sends the full image)
+  #define IMAGE_LOW_POWER_CAPTURE_INTERVAL 30 // Minutes without image packets after a full image was cut short, unless solar power recovers earlier
+
+  #define IMAGE_ADAPTIVE_ENABLE // Choose frame size and quality per capture to fit the image into a packet budget from solar power and time of day
+  #define IMAGE_PROFILES {{FRAMESIZE_QVGA, 12, 2, 60}, {FRAMESIZE_HVGA, 8, 3, 140}, {OV2640_FRAMESIZE, OV2640_JPEG_QUALITY, SSDV_JPEG_QUALITY, 300}} // Frame size (up to OV2640_FRAMESIZE), OV2640 JPEG quality, SSDV quality and expected SSDV NOFEC packets, smallest image first
+  #define IMAGE_PROFILE_DECAY_PERCENT 5 // Expected packets of the next larger profile shrink by X percent per image it did not fit, so a downgrade is tried again
+  #define IMAGE_BUDGET_PACKETS 300 // Packet budget of an image with full solar power in daylight
+  #define IMAGE_BUDGET_SOLAR_HIGH 2000 // Solar voltage reading from which the full budget is available, half budget below
+  #define IMAGE_BUDGET_SOLAR_LOW 800 // Below this solar voltage reading a quarter of the budget is available
+  #define IMAGE_BUDGET_DAY_START 480 // Local solar time in minutes of the day from which the full budget is available, half budget before
+  #define IMAGE_BUDGET_DAY_END 960 // Local solar time in minutes of the day until which the full budget is available, half budget after
+
+  #define IMAGE_ID_NVS_INTERVAL 16 // Write running image ID to NVS every X images, the RTC state block keeps it across software restarts
+
 /*
  * Environment sensor config
  */
@@ -169,7 +233,18 @@
   #define CACHE_APRS_SOURCE_SSID 9
 
   #define CACHE_RUN_HANDLER_EVERY 15 // Run cache handler after every X position packets
-  #define CACHE_LENGTH 250 // Cache length must be an even!
+  #define CACHE_LENGTH 125 // Number of cached positions at full rate
+
+  #define CACHE_SIMPLIFY_TOLERANCE 5 // Max deviation of dropped positions from the straight track in deg*100 (~5km)
+  #define CACHE_SIMPLIFY_WINDOW 8 // Max positions merged into one straight track segment
+
+  #define CACHE_TIER1_INTERVAL 60 // Minutes between positions kept in the hourly tier
+  #define CACHE_TIER1_LENGTH 24 // Number of positions of the hourly tier
+  #define CACHE_TIER2_INTERVAL 360 // Minutes between positions kept in the 6-hourly tier
+  #define CACHE_TIER2_LENGTH 28 // Number of positions of the 6-hourly tier
+  #define CACHE_TIER3_INTERVAL 1440 // Minutes between positions kept in the daily tier
+  #define CACHE_TIER3_LENGTH 60 // Number of positions of the daily tier
+  #define CACHE_FRAME_TIER_SHARES {50, 20, 15, 15} // Percent of a cache frame for the full rate tier and the hourly, 6-hourly and daily tier, unused space moves on to the next coarser tier
 
 /*
  * Solar config
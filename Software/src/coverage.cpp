@@ -0,0 +1,85 @@
+/*
+ * This file is part of a radiosonde firmware.
+ * 
+ 
+ * Copyright (C) 2023  Amon Schumann / DL9AS
+ 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */ 
+
+#include <Arduino.h>
+
+#include "coverage.h"
+#include "config.h"
+#include "defines.h"
+#include "globals.h"
+
+#if TARGET == TARGET_RS_1TO3
+    #include <avr/pgmspace.h>
+    #define PROGMEM_CUSTOM PROGMEM
+#elif TARGET == TARGET_RS_4
+    #define PROGMEM_CUSTOM
+#endif
+
+// Module globals
+// Reception likelihood grid, generated offline from igate locations by tools/coverage_grid.py
+#include "coverage_grid.h"
+
+// Exported functions
+
+// Get igate reception likelihood level - latitude and longitude in decimal degrees *100
+uint8_t coverage_get_level(int16_t latitude_DD, int16_t longitude_DD)
+{
+  // Invalid gnss position -> keep default schedule
+  if(latitude_DD == 0 && longitude_DD == 0) return COVERAGE_MEDIUM;
+
+  int16_t row = ((int32_t) latitude_DD + 9000) / COVERAGE_GRID_STEP; // 32 bit, int is 16 bit on AVR and longitudes east of ~147.67 deg overflow
+  int16_t column = ((int32_t) longitude_DD + 18000) / COVERAGE_GRID_STEP;
+
+  // Clamp poles and date line to the outermost cells
+  row = constrain(row, (int16_t) 0, (int16_t) (COVERAGE_GRID_ROWS - 1));
+  column = constrain(column, (int16_t) 0, (int16_t) (COVERAGE_GRID_COLUMNS - 1));
+
+  uint16_t cell = row * COVERAGE_GRID_COLUMNS + column;
+  uint8_t level = (pgm_read_byte_near(coverage_grid + (cell >> 2)) >> ((cell & 0x03) * 2)) & 0x03; // 4 cells with 2 bit each per byte
+
+  DEBUG_PRINT("[COV] Level: ");
+  DEBUG_PRINTLN(level);
+
+  return level;
+}
+
+// Get delay between radio packets in ms for a reception likelihood level
+uint32_t coverage_get_packet_delay(uint8_t level)
+{
+  switch(level)
+  {
+    case COVERAGE_NONE: return COVERAGE_PACKET_DELAY_NONE;
+    case COVERAGE_LOW: return COVERAGE_PACKET_DELAY_LOW;
+    case COVERAGE_HIGH: return COVERAGE_PACKET_DELAY_HIGH;
+    default: return RADIO_PACKET_DELAY;
+  }
+}
+
+// Get expected packet error rate in percent for a reception likelihood level
+uint8_t coverage_get_packet_error_rate(uint8_t level)
+{
+  switch(level)
+  {
+    case COVERAGE_NONE: return COVERAGE_PACKET_ERROR_RATE_NONE;
+    case COVERAGE_LOW: return COVERAGE_PACKET_ERROR_RATE_LOW;
+    case COVERAGE_HIGH: return COVERAGE_PACKET_ERROR_RATE_HIGH;
+    default: return IMAGE_PACKET_ERROR_RATE;
+  }
+}
@@ -0,0 +1,35 @@
+/*
+ * This file is part of a radiosonde firmware.
+ * 
+ 
+ * Copyright (C) 2023  Amon Schumann / DL9AS
+ 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */ 
+
+#ifndef __COVERAGE__H__
+#define __COVERAGE__H__
+
+#include <Arduino.h>
+
+#define COVERAGE_GRID_STEP 500 // Grid cell size in decimal degrees *100, must match tools/coverage_grid.py
+#define COVERAGE_GRID_ROWS (18000 / COVERAGE_GRID_STEP)
+#define COVERAGE_GRID_COLUMNS (36000 / COVERAGE_GRID_STEP)
+
+// Exported functions
+uint8_t coverage_get_level(int16_t latitude_DD, int16_t longitude_DD);
+uint32_t coverage_get_packet_delay(uint8_t level);
+uint8_t coverage_get_packet_error_rate(uint8_t level);
+
+#endif
@@ -27,6 +27,7 @@
 
 #define MOD_DIO2 0
 #define MOD_F_HOP 1
+#define MOD_F_HOP_DDS 2
 
 #define SX1278_INTERNAL 0
 #define DS18B20 1
@@ -37,4 +38,22 @@
 #define NVS_RESET 0
 #define NVS_RUNNING 1
 
+#define COVERAGE_NONE 0
+#define COVERAGE_LOW 1
+#define COVERAGE_MEDIUM 2
+#define COVERAGE_HIGH 3
+
+#define OV2640_POWER_COLD 0
+#define OV2640_POWER_WARM 1
+
+#define EDGE_TIMING_OFF 0
+#define EDGE_TIMING_MEASURE 1
+
+#define IMAGE_TRANSPORT_SSDV 0
+#define IMAGE_TRANSPORT_FOUNTAIN 1
+
+#define IMAGE_SSDV_FEC_OFF 0
+#define IMAGE_SSDV_FEC_ON 1
+#define IMAGE_SSDV_FEC_AUTO 2
+
 #endif
\ No newline at end of file
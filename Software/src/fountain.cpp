@@ -0,0 +1,104 @@
+/*
+ * This file is part of a radiosonde firmware.
+ * 
+ 
+ * Copyright (C) 2023  Amon Schumann / DL9AS
+ 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */ 
+
+#include <Arduino.h>
+
+#include "fountain.h"
+#include "image_store.h"
+#include "config.h"
+#include "globals.h"
+
+/*
+ * Fountain coded image transport:
+ * The SSDV packets of the current image in the image store are the source symbols of a systematic random linear
+ * fountain code. Frames with a sequence number below the source symbol count K carry the source symbols unchanged,
+ * all further frames carry repair symbols: the XOR of a random half of all source symbols. The source symbols are
+ * drawn by hashing block ID, sequence number and source index, so the ground decoder (tools/fountain_decode.py) can
+ * repeat the draw. Any set of about K + 2 different frames heard by any igates reconstructs the image, duplicates
+ * do not hurt. Sparse LT degree distributions need far more overhead at the few hundred packets of an image, while
+ * reading K/2 packets from flash per repair frame is cheap.
+ *
+ * Frame format:
+ *   [BLOCK ID]     SSDV image ID of the first source symbol (1 byte)
+ *   [K][SEQUENCE]  Source symbol count and sequence number, 12 bit each (3 bytes, big endian)
+ *   [SYMBOL]       SSDV packet from image ID on, without CRC
+ */
+
+// Module functions
+
+// MurmurHash3 finalizer, it multiplies, a GF(2) linear generator like xorshift would make repair symbols dependent
+static uint32_t fountain_hash(uint32_t value)
+{
+  value ^= value >> 16;
+  value *= 0x85EBCA6B;
+  value ^= value >> 13;
+  value *= 0xC2B2AE35;
+  value ^= value >> 16;
+
+  return value;
+}
+
+// XOR source symbol into symbol
+static void fountain_add_source(uint16_t index, uint8_t* symbol)
+{
+  uint8_t packet[IMAGE_PACKET_LENGTH];
+  image_store_read(index, packet);
+
+  for(uint8_t i = 0; i < FOUNTAIN_SYMBOL_LENGTH; i++) symbol[i] ^= packet[FOUNTAIN_SYMBOL_OFFSET + i];
+}
+
+// Exported functions
+
+// Encode frame with sequence number of the current image into FOUNTAIN_FRAME_LENGTH bytes
+void fountain_encode(uint16_t source_count, uint16_t sequence, uint8_t* frame)
+{
+  uint8_t* symbol = frame + FOUNTAIN_HEADER_LENGTH;
+  uint8_t packet[IMAGE_PACKET_LENGTH];
+
+  if(source_count > FOUNTAIN_MAX_SOURCE_COUNT) source_count = FOUNTAIN_MAX_SOURCE_COUNT; // K is 12 bit in the header, further packets are not coded
+
+  image_store_read(0, packet);
+  uint8_t block_id = packet[FOUNTAIN_SYMBOL_OFFSET];
+
+  frame[0] = block_id;
+  frame[1] = source_count >> 4;
+  frame[2] = (source_count << 4) | ((sequence >> 8) & 0x0F);
+  frame[3] = sequence & 0xFF;
+
+  memset(symbol, 0, FOUNTAIN_SYMBOL_LENGTH);
+
+  if(sequence < source_count) // Source symbol
+  {
+    fountain_add_source(sequence, symbol);
+    return;
+  }
+
+  // Repair symbol, each random bit selects one source symbol
+  uint32_t seed = fountain_hash(((uint32_t) block_id << 16) | sequence);
+  uint32_t bits = 0;
+
+  for(uint16_t index = 0; index < source_count; index++)
+  {
+    if(index % 32 == 0) bits = fountain_hash(seed + index / 32 * 0x9E3779B9);
+    if(bits & ((uint32_t) 1 << (index % 32))) fountain_add_source(index, symbol);
+
+    WDT_RESET;
+  }
+}
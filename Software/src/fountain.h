@@ -0,0 +1,38 @@
+/*
+ * This file is part of a radiosonde firmware.
+ * 
+ 
+ * Copyright (C) 2023  Amon Schumann / DL9AS
+ 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */ 
+
+#ifndef __FOUNTAIN__H__
+#define __FOUNTAIN__H__
+
+#include <Arduino.h>
+
+#include "config.h"
+
+#define FOUNTAIN_HEADER_LENGTH 4 // Block ID, source symbol count and sequence number
+#define FOUNTAIN_SYMBOL_OFFSET 6 // Symbols start at the SSDV image ID, sync byte, packet type and callsign are fixed
+#define FOUNTAIN_SYMBOL_LENGTH (IMAGE_PACKET_LENGTH - FOUNTAIN_SYMBOL_OFFSET - 4) // Without SSDV CRC, recalculated on ground
+#define FOUNTAIN_FRAME_LENGTH (FOUNTAIN_HEADER_LENGTH + FOUNTAIN_SYMBOL_LENGTH)
+#define FOUNTAIN_MAX_SOURCE_COUNT 4095 // Source symbol count is 12 bit in the frame header
+#define FOUNTAIN_MAX_FRAME_COUNT 4096 // Sequence number is 12 bit in the frame header
+
+// Exported functions
+void fountain_encode(uint16_t source_count, uint16_t sequence, uint8_t* frame);
+
+#endif
@@ -46,6 +46,7 @@ int quality_indicator = 0;
 int satellites = 0;
 long int altitude = 0;
 char raw_time[10];
+uint16_t gps_days = 0; // Days since 2000-01-01, 0 if no date received yet
 
 int speed = 0;
 int course = 0;
@@ -63,6 +64,31 @@ void gps_end()
   gps_serial_interface.end();
 }
 
+// Module functions
+
+// Parse date from RMC sentence field 9 (ddmmyy) into days since 2000-01-01
+static void gps_parse_date(const char* rmc_sentence)
+{
+  uint8_t field = 0;
+  while(*rmc_sentence != '\0' && field < 9) if(*rmc_sentence++ == ',') field++;
+
+  for(uint8_t i = 0; i < 6; i++) if(rmc_sentence[i] < '0' || rmc_sentence[i] > '9') return; // No valid date yet
+
+  int16_t day = (rmc_sentence[0] - '0') * 10 + (rmc_sentence[1] - '0');
+  int16_t month = (rmc_sentence[2] - '0') * 10 + (rmc_sentence[3] - '0');
+  int16_t year = 2000 + (rmc_sentence[4] - '0') * 10 + (rmc_sentence[5] - '0');
+
+  // Days from civil date, based on algorithm from Howard Hinnant - http://howardhinnant.github.io/date_algorithms.html
+  if(month <= 2) year--;
+  int32_t era_year = year - 1600; // 400 year era starting 1600-03-01
+  int32_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int32_t day_of_era = era_year * 365 + era_year / 4 - era_year / 100 + era_year / 400 + day_of_year;
+
+  gps_days = day_of_era - 146037; // 2000-01-01 is day 146037 of the era
+}
+
+// Exported functions
+
 // Sleep function while keeping GPS running
 void gps_proccess_for_ms(uint32_t duration_ms)
 {
@@ -86,11 +112,13 @@ void gps_proccess_for_ms(uint32_t duration_ms)
     {
       if (gps_serial_interface.find('$')) // NMEA sentence starts with '$'
       {
-        gps_serial_interface.readBytesUntil('\n', gps_input_buffer, 128); // Read in single NMEA sentence
+        size_t sentence_length = gps_serial_interface.readBytesUntil('\n', gps_input_buffer, 127); // Read in single NMEA sentence
+        gps_input_buffer[sentence_length] = '\0';
         // Parse GNGGA or GPGGA sentence from GPS receiver
         sscanf(gps_input_buffer, GPS_PARSE_SENTENCE_GGA",%10[^,],%2d%2d.%2d%*[^,],%c,%3d%2d.%2d%*[^,],%c,%d,%d,%*[^,],%ld", raw_time, &dd_lat, &mm_lat, &last_mm_lat, &direction_lat, &dd_long, &mm_long, &last_mm_long, &direction_long, &quality_indicator, &satellites, &altitude);
         // Parse GNRMC or GPRMC from GPS receiver
         sscanf(gps_input_buffer, GPS_PARSE_SENTENCE_RMC",%*[^,],%*c,%*[^,],%*c,%*[^,],%*c,%d.%*d,%d", &speed, &course);
+        if(strncmp(gps_input_buffer, GPS_PARSE_SENTENCE_RMC, 5) == 0) gps_parse_date(gps_input_buffer);
 
         //DEBUG_PRINTLN(gps_input_buffer);
       }
@@ -132,4 +160,21 @@ void gps_convert_coordinates_to_DD(int16_t *latitude_DD, int16_t *longitude_DD)
   DEBUG_PRINTLN(*latitude_DD);
   DEBUG_PRINT("[GPS] DD long: ");
   DEBUG_PRINTLN(*longitude_DD);
+}
+
+// Get UTC time of last fix in minutes since 2000-01-01 modulo 2^16 (~45 days), minute of day if no date received yet
+uint16_t gps_get_time_minutes()
+{
+  int16_t minute_of_day = gps_get_minute_of_day();
+  if(minute_of_day < 0) return 0;
+
+  return (uint32_t) gps_days * 1440 + minute_of_day;
+}
+
+// Get UTC minute of day of last fix, -1 if no time received yet
+int16_t gps_get_minute_of_day()
+{
+  for(uint8_t i = 0; i < 4; i++) if(raw_time[i] < '0' || raw_time[i] > '9') return -1; // Time format hhmmss.ss
+
+  return ((raw_time[0] - '0') * 10 + (raw_time[1] - '0')) * 60 + (raw_time[2] - '0') * 10 + (raw_time[3] - '0');
 }
\ No newline at end of file
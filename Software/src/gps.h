@@ -27,6 +27,7 @@ extern int quality_indicator;
 extern int satellites;
 extern long int altitude;
 extern char raw_time[10];
+extern uint16_t gps_days;
 
 extern int speed;
 extern int course;
@@ -38,5 +39,7 @@ void gps_proccess_for_ms(uint32_t duration_ms);
 
 void gps_convert_coordinates_to_DMH(char* latitude_DMH, char* longitude_DMH);
 void gps_convert_coordinates_to_DD(int16_t *latitude_DD, int16_t *longitude_DD);
+uint16_t gps_get_time_minutes();
+int16_t gps_get_minute_of_day();
 
 #endif
@@ -0,0 +1,283 @@
+/*
+ * This file is part of a radiosonde firmware.
+ * 
+ 
+ * Copyright (C) 2023  Amon Schumann / DL9AS
+ 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */ 
+
+#include <Arduino.h>
+
+#include "image_store.h"
+#include "config.h"
+#include "globals.h"
+#include "esp_partition.h"
+
+/*
+ * Image store:
+ * All SSDV packets of a capture are encoded right after capture and appended to the ssdv flash partition, so the
+ * camera frame buffers can be released before the downlink starts. The transmit path then pops one packet after the
+ * other.
+ *
+ * The partition is split into IMAGE_ARCHIVE_IMAGES areas, each new image overwrites the oldest one. The first slot
+ * of an area holds a header, written once all packets of the image are stored. Every packet occupies one
+ * IMAGE_STORE_PACKET_SLOT, sectors are erased right before the first slot in them is written. The headers are
+ * scanned on boot, so archived images survive restarts. Every IMAGE_CAROUSEL_INTERVAL-th pop retransmits a packet
+ * of an archived image instead, round robin over all their packets, so ground stations can complete images later.
+ *
+ * Behind the header, slot 0 holds the sent marks of the image: each sent packet clears one more bit of the erased
+ * flash, no erase needed. After a restart or power loss the newest image continues at the first set bit.
+ */
+
+// Area header, erased flash reads 0xFF
+typedef struct
+{
+  uint32_t sequence; // Increments with every image
+  uint16_t packet_count;
+  uint16_t packet_count_inverted; // Detects blank or torn header
+  uint16_t thumbnail_count; // Packets of the thumbnail at the begin of the image
+} image_store_header_t;
+
+// Module globals
+const esp_partition_t* p_image_store_partition = NULL;
+uint32_t image_store_area_size = 0; // Bytes per archive area
+uint32_t image_store_sequence = 0; // Sequence number of the next image
+uint8_t image_store_area = 0; // Area of the current image
+uint16_t image_store_write_index = 0; // Packet of the current image to be pushed next
+uint16_t image_store_read_index = 0; // Packet of the current image to be sent next
+uint16_t image_store_marked = 0; // Sent packets of the current image marked in flash
+uint16_t image_store_thumbnail_count = 0; // Thumbnail packets of the current image
+
+uint16_t image_store_archive_count[IMAGE_ARCHIVE_IMAGES]; // Packets of archived images, 0 if area empty
+uint8_t image_store_carousel_area = 0; // Area of the next retransmitted packet
+uint16_t image_store_carousel_index = 0; // Packet of the next retransmitted packet
+uint16_t image_store_pop_counter = 0;
+
+// Module functions
+static uint32_t image_store_get_packet_offset(uint8_t area, uint16_t index)
+{
+  return area * image_store_area_size + (uint32_t) (index + 1) * IMAGE_STORE_PACKET_SLOT; // Slot 0 is the header
+}
+
+static bool image_store_read_header(uint8_t area, image_store_header_t* header)
+{
+  esp_partition_read(p_image_store_partition, area * image_store_area_size, header, sizeof(image_store_header_t));
+
+  return header->packet_count == (uint16_t) ~header->packet_count_inverted;
+}
+
+// Get number of sent packets marked in slot 0 of an area
+static uint16_t image_store_read_progress(uint8_t area)
+{
+  uint8_t marks[IMAGE_STORE_PACKET_SLOT - IMAGE_STORE_PROGRESS_OFFSET];
+  esp_partition_read(p_image_store_partition, area * image_store_area_size + IMAGE_STORE_PROGRESS_OFFSET, marks, sizeof(marks));
+
+  uint16_t progress = 0;
+  for(uint8_t i = 0; i < sizeof(marks) && marks[i] == 0x00; i++) progress += 8;
+  if(progress < IMAGE_STORE_PROGRESS_MARKS) progress += __builtin_ctz(marks[progress / 8] | 0x100); // Marks clear bits from LSB
+
+  return progress;
+}
+
+// Clear marks up to sent packets of the current image, bits can be cleared without erasing the sector
+static void image_store_mark_progress(uint16_t sent)
+{
+  if(!image_store_is_available()) return;
+
+  if(sent > IMAGE_STORE_PROGRESS_MARKS) sent = IMAGE_STORE_PROGRESS_MARKS;
+  if(sent <= image_store_marked) return;
+
+  for(uint16_t i = image_store_marked / 8; i <= (sent - 1) / 8; i++)
+  {
+    uint8_t mark = i < (sent - 1) / 8 ? 0x00 : (uint8_t) (0xFF << ((sent - 1) % 8 + 1));
+    esp_partition_write(p_image_store_partition, image_store_area * image_store_area_size + IMAGE_STORE_PROGRESS_OFFSET + i, &mark, 1);
+  }
+
+  image_store_marked = sent;
+}
+
+// Get next packet of an archived image, returns false if there is none
+static bool image_store_pop_archived(uint8_t* packet)
+{
+  for(uint8_t i = 0; i <= IMAGE_ARCHIVE_IMAGES; i++)
+  {
+    if(image_store_carousel_area != image_store_area && image_store_carousel_index < image_store_archive_count[image_store_carousel_area])
+    {
+      esp_partition_read(p_image_store_partition, image_store_get_packet_offset(image_store_carousel_area, image_store_carousel_index), packet, IMAGE_PACKET_LENGTH);
+      image_store_carousel_index++;
+
+      return true;
+    }
+
+    // Continue with the next archived image
+    image_store_carousel_area = (image_store_carousel_area + 1) % IMAGE_ARCHIVE_IMAGES;
+    image_store_carousel_index = 0;
+  }
+
+  return false;
+}
+
+// Exported functions
+void image_store_begin(void)
+{
+  p_image_store_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, IMAGE_STORE_PARTITION);
+
+  if(p_image_store_partition == NULL)
+  {
+    DEBUG_PRINTLN("[IMG] No store partition, encode while sending");
+    return;
+  }
+
+  image_store_area_size = p_image_store_partition->size / IMAGE_ARCHIVE_IMAGES / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+
+  // Find archived images, the next image overwrites the oldest area
+  bool is_empty = true;
+  uint8_t archived_images = 0;
+  image_store_header_t header;
+  for(uint8_t area = 0; area < IMAGE_ARCHIVE_IMAGES; area++)
+  {
+    image_store_archive_count[area] = 0;
+    if(!image_store_read_header(area, &header)) continue;
+
+    archived_images++;
+
+    image_store_archive_count[area] = header.packet_count;
+    if(is_empty || header.sequence >= image_store_sequence)
+    {
+      is_empty = false;
+      image_store_sequence = header.sequence + 1;
+      image_store_area = area; // Newest area, advanced by image_store_new_image()
+      image_store_thumbnail_count = header.thumbnail_count;
+    }
+  }
+
+  // Newest image stays current, sending continues where it stopped
+  if(!is_empty)
+  {
+    image_store_write_index = image_store_archive_count[image_store_area];
+    image_store_marked = image_store_read_progress(image_store_area);
+    image_store_read_index = image_store_marked;
+  }
+
+  DEBUG_PRINT("[IMG] Archived images/sent of newest: ");
+  DEBUG_PRINT(archived_images);
+  DEBUG_PRINT("/");
+  DEBUG_PRINTLN(image_store_read_index);
+}
+
+// Packets are only stored if the partition exists, otherwise SSDV encodes them from the frame buffer while sending
+bool image_store_is_available(void)
+{
+  #ifdef IMAGE_PREENCODE_ENABLE
+    return p_image_store_partition != NULL;
+  #else
+    return false;
+  #endif
+}
+
+// Start storing a new image in place of the oldest one
+void image_store_new_image(void)
+{
+  image_store_area = (image_store_area + 1) % IMAGE_ARCHIVE_IMAGES;
+  image_store_archive_count[image_store_area] = 0;
+  image_store_write_index = 0;
+  image_store_read_index = 0;
+  image_store_marked = 0;
+  image_store_thumbnail_count = 0;
+
+  esp_partition_erase_range(p_image_store_partition, image_store_area * image_store_area_size, SPI_FLASH_SEC_SIZE); // Header sector, also if the image closes without packets
+}
+
+// Append packet of IMAGE_PACKET_LENGTH bytes, returns false if the area is full
+bool image_store_push(const uint8_t* packet)
+{
+  uint32_t offset = image_store_get_packet_offset(image_store_area, image_store_write_index);
+  if(offset + IMAGE_STORE_PACKET_SLOT > (image_store_area + 1) * image_store_area_size) return false;
+
+  if(image_store_write_index > 0 && offset % SPI_FLASH_SEC_SIZE == 0) esp_partition_erase_range(p_image_store_partition, offset, SPI_FLASH_SEC_SIZE); // Entered new sector
+
+  esp_partition_write(p_image_store_partition, offset, packet, IMAGE_PACKET_LENGTH);
+  image_store_write_index++;
+
+  return true;
+}
+
+// Write header after the last packet, the image is archived from now on
+void image_store_close_image(uint16_t thumbnail_count)
+{
+  image_store_thumbnail_count = thumbnail_count;
+
+  image_store_header_t header;
+  header.sequence = image_store_sequence++;
+  header.packet_count = image_store_write_index;
+  header.packet_count_inverted = ~image_store_write_index;
+  header.thumbnail_count = thumbnail_count;
+
+  esp_partition_write(p_image_store_partition, image_store_area * image_store_area_size, &header, sizeof(header));
+  image_store_archive_count[image_store_area] = image_store_write_index;
+}
+
+// Stop sending the current image, it stays archived
+void image_store_drop_image(void)
+{
+  image_store_set_sent(image_store_write_index);
+}
+
+// Get next packet to send, returns false after the last one of the current image
+bool image_store_pop(uint8_t* packet)
+{
+  if(image_store_read_index >= image_store_write_index) return false;
+
+  #if IMAGE_CAROUSEL_INTERVAL > 0
+    image_store_pop_counter++;
+    if(image_store_pop_counter % IMAGE_CAROUSEL_INTERVAL == 0 && image_store_pop_archived(packet)) return true; // Retransmit archived packet
+  #endif
+
+  esp_partition_read(p_image_store_partition, image_store_get_packet_offset(image_store_area, image_store_read_index), packet, IMAGE_PACKET_LENGTH);
+  image_store_set_sent(image_store_read_index + 1);
+
+  return true;
+}
+
+// Get packet of the current image by index, e.g. for fountain coding
+void image_store_read(uint16_t index, uint8_t* packet)
+{
+  esp_partition_read(p_image_store_partition, image_store_get_packet_offset(image_store_area, index), packet, IMAGE_PACKET_LENGTH);
+}
+
+// Number of packets of the current image stored
+uint16_t image_store_get_count(void)
+{
+  return image_store_write_index;
+}
+
+// Number of packets of the current image popped
+uint16_t image_store_get_sent(void)
+{
+  return image_store_read_index;
+}
+
+// Set number of sent packets of the current image, marked in flash to continue after a restart
+void image_store_set_sent(uint16_t sent)
+{
+  image_store_read_index = sent;
+  image_store_mark_progress(sent);
+}
+
+// Number of thumbnail packets at the begin of the current image
+uint16_t image_store_get_thumbnail_count(void)
+{
+  return image_store_thumbnail_count;
+}
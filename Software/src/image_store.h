@@ -0,0 +1,47 @@
+/*
+ * This file is part of a radiosonde firmware.
+ * 
+ 
+ * Copyright (C) 2023  Amon Schumann / DL9AS
+ 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */ 
+
+#ifndef __IMAGE_STORE__H__
+#define __IMAGE_STORE__H__
+
+#include <Arduino.h>
+
+#include "config.h"
+
+#define IMAGE_STORE_PARTITION "ssdv" // Flash partition for encoded SSDV packets, see partitions.csv
+#define IMAGE_STORE_PACKET_SLOT 256 // Flash bytes reserved per stored packet, 16 packets per flash sector
+#define IMAGE_STORE_PROGRESS_OFFSET 16 // Sent marks follow the header in slot 0, one bit per sent packet
+#define IMAGE_STORE_PROGRESS_MARKS ((IMAGE_STORE_PACKET_SLOT - IMAGE_STORE_PROGRESS_OFFSET) * 8)
+
+// Exported functions
+void image_store_begin(void);
+bool image_store_is_available(void);
+void image_store_new_image(void);
+bool image_store_push(const uint8_t* packet);
+void image_store_close_image(uint16_t thumbnail_count);
+void image_store_drop_image(void);
+void image_store_read(uint16_t index, uint8_t* packet);
+bool image_store_pop(uint8_t* packet);
+uint16_t image_store_get_count(void);
+uint16_t image_store_get_sent(void);
+void image_store_set_sent(uint16_t sent);
+uint16_t image_store_get_thumbnail_count(void);
+
+#endif
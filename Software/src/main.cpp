@@ -27,14 +27,20 @@
 #include "voltage.h"
 #include "DS18B20.h"
 #include "defines.h"
+#ifdef COVERAGE_ENABLE
+  #include "coverage.h"
+#endif
 #if TARGET == TARGET_RS_4
   #include "camera.h"
+  #include "image_store.h"
   #ifdef CACHE_ENABLE
     #include "cache.h"
+    #include "track.h"
   #endif
   // ESP specific includes
   #include "soc/soc.h" // Disable brownout detector
   #include "soc/rtc_cntl_reg.h" // Disable brownout detector
+  #include "state.h"
   #if NVS_STATUS == NVS_RESET
     #include <nvs_flash.h>
   #endif
@@ -44,8 +50,13 @@
 uint64_t global_freq = APRS_FREQUENCY_DEFAULT; // Global APRS frequency
 
 uint16_t aprs_packet_counter = 0;
+uint8_t coverage_level = COVERAGE_MEDIUM; // Igate reception likelihood at last position
 #if TARGET == TARGET_RS_4
   int16_t image_packet_counter = -1;
+  #ifdef IMAGE_THUMBNAIL_ENABLE
+    bool image_is_cut = false; // Full image cut short for low power, wait before the next capture
+    uint32_t image_cut_ms = 0; // millis() when the full image was cut
+  #endif
 #endif
 
 #if TARGET == TARGET_RS_4
@@ -55,11 +66,16 @@ uint16_t aprs_packet_counter = 0;
 
 // Module functions
 void main_generate_aprs_position_packet();
+uint32_t main_get_packet_delay();
+void main_wait_for_ms(uint32_t ms);
+uint8_t main_get_packet_error_rate();
 #if TARGET == TARGET_RS_4
   void pre_img_loop();
   void main_generate_aprs_image_packet();
   void main_capture_image();
   void main_handle_cache();
+  void main_save_state();
+  uint16_t main_get_image_packet_budget();
 #endif
 
 void setup()
@@ -68,6 +84,15 @@ void setup()
 
   #if TARGET == TARGET_RS_4
     WRITE_PERI_REG(RTC_CNTL_BROWN_OUT_REG, 0); // Disable brownout detector
+
+    // Restore runtime state from RTC memory before any NVS access
+    state_t state;
+    bool state_restored = state_restore(&state);
+    if(state_restored)
+    {
+      aprs_packet_counter = state.aprs_packet_counter;
+      gps_days = state.gps_days;
+    }
   #endif
 
   // Enable or disable debug serial
@@ -75,6 +100,10 @@ void setup()
     Serial.begin(DEBUG_SERIAL_BAUD_RATE);
   #endif
 
+  #if TARGET == TARGET_RS_4
+    DEBUG_PRINTLN(state_restored ? "[STATE] Restored" : "[STATE] Cold boot"); // Restored before serial was up
+  #endif
+
   // Initialize watchdog
   DEBUG_PRINTLN("[WDT] Init");
   WDT_INIT;
@@ -98,29 +127,43 @@ void setup()
 
     DEBUG_PRINTLN("[CAM] Begin");
     camera_begin(p_pref);
+    image_store_begin();
     #ifdef CACHE_ENABLE
-      cache_begin(p_pref);
+      cache_begin(); // Rebuild cache from flash log
     #endif
     p_pref->begin("DL9AS", false); // Open preferences namespace
-    pre_img_loop(); // Run this loop before initializing camera
+
+    if(state_restored) // Software restart in flight
+    {
+      camera_set_image_id(state.image_id);
+    }
+    else // Power on, fall back to NVS
+    {
+      camera_load_image_id();
+      pre_img_loop(); // Run this loop before initializing camera
+    }
+    main_save_state();
   #endif
 }
 
 void loop()
 {
-  gps_proccess_for_ms(RADIO_PACKET_DELAY); // Sleep with GPS running
+  main_wait_for_ms(main_get_packet_delay()); // Sleep with GPS running
 
   main_generate_aprs_position_packet();
 
   #if TARGET == TARGET_RS_4
-    gps_proccess_for_ms(RADIO_PACKET_DELAY); // Sleep with GPS running
+    if(coverage_level >= COVERAGE_MIN_LEVEL_IMAGE) // Skip image packets where no igate is likely to hear them
+    {
+      main_wait_for_ms(main_get_packet_delay()); // Sleep with GPS running
 
-    main_generate_aprs_image_packet();
+      main_generate_aprs_image_packet();
+    }
 
     #ifdef CACHE_ENABLE
-      if(aprs_packet_counter % CACHE_RUN_HANDLER_EVERY == 0)
+      if(aprs_packet_counter % CACHE_RUN_HANDLER_EVERY == 0 && coverage_level >= COVERAGE_MIN_LEVEL_CACHE)
       {
-        gps_proccess_for_ms(RADIO_PACKET_DELAY); // Sleep with GPS running
+        main_wait_for_ms(main_get_packet_delay()); // Sleep with GPS running
 
         main_handle_cache();
       }  
@@ -128,6 +171,43 @@ void loop()
   #endif
 }
 
+// Get delay between radio packets depending on igate coverage at the last position
+uint32_t main_get_packet_delay()
+{
+  #ifdef COVERAGE_ENABLE
+    return coverage_get_packet_delay(coverage_level);
+  #else
+    return RADIO_PACKET_DELAY;
+  #endif
+}
+
+// Sleep with GPS running, a pending image is encoded in slices meanwhile
+void main_wait_for_ms(uint32_t ms)
+{
+  uint32_t wait_start_ms = millis();
+
+  #if TARGET == TARGET_RS_4
+    while(camera_is_encoding() && millis() - wait_start_ms + IMAGE_ENCODE_SLICE_MS + IMAGE_ENCODE_GPS_MS <= ms)
+    {
+      camera_encode_for_ms(IMAGE_ENCODE_SLICE_MS);
+      gps_proccess_for_ms(IMAGE_ENCODE_GPS_MS); // Keep up with GPS messages between slices
+    }
+  #endif
+
+  uint32_t elapsed_ms = millis() - wait_start_ms;
+  if(elapsed_ms < ms) gps_proccess_for_ms(ms - elapsed_ms);
+}
+
+// Get expected packet error rate in percent depending on igate coverage at the last position
+uint8_t main_get_packet_error_rate()
+{
+  #ifdef COVERAGE_ENABLE
+    return coverage_get_packet_error_rate(coverage_level);
+  #else
+    return IMAGE_PACKET_ERROR_RATE;
+  #endif
+}
+
 #if TARGET == TARGET_RS_4
   void pre_img_loop() // Loop for actions before camera initialized
   {
@@ -155,6 +235,11 @@ void main_generate_aprs_position_packet()
   gps_convert_coordinates_to_DD(&DD_latitude_buf, &DD_longitude_buf);
   global_freq = geofence_get_aprs_frequency(DD_latitude_buf, DD_longitude_buf);
 
+  // Get igate reception likelihood for packet scheduling
+  #ifdef COVERAGE_ENABLE
+    coverage_level = coverage_get_level(DD_latitude_buf, DD_longitude_buf);
+  #endif
+
   // Acquire environmental data
   voltage_get_measurements();
   TEMP_MEASURE;
@@ -209,6 +294,10 @@ void main_generate_aprs_position_packet()
   // Increment APRS packet counter
   aprs_packet_counter++;
 
+  #if TARGET == TARGET_RS_4
+    main_save_state();
+  #endif
+
   GPS_BEGIN_BETWEEN;
 }
 
@@ -217,19 +306,41 @@ void main_generate_aprs_position_packet()
   {
     if(image_packet_counter == -1) // Go here after startup
     {
-      DEBUG_PRINTLN("[CAM] Capture new image");
-      main_capture_image(); // ESP needs to be restarted for next image
+      if(!camera_resume_image()) // Continue image interrupted by a restart or power loss
+      {
+        DEBUG_PRINTLN("[CAM] Capture new image");
+        main_capture_image(); // ESP needs to be restarted for next image
+      }
       image_packet_counter = 0;
     }
+    #ifdef IMAGE_THUMBNAIL_ENABLE
+      else if(image_is_cut) // No image packets until the capture interval passed or power recovered, a capture per thumbnail would cost more than the full image
+      {
+        if(solar_voltage < IMAGE_FULL_MIN_SOLAR_VOLTAGE && millis() - image_cut_ms < IMAGE_LOW_POWER_CAPTURE_INTERVAL * 60000UL) return;
+
+        image_is_cut = false;
+        DEBUG_PRINTLN("[CAM] Capture new image");
+        main_capture_image();
+        image_packet_counter = 0;
+      }
+      else if(!camera_is_sending_thumbnail() && solar_voltage < IMAGE_FULL_MIN_SOLAR_VOLTAGE) // Power tight, cut full image short
+      {
+        DEBUG_PRINTLN("[IMG] Low power, skip full IMG");
+        camera_end_image();
+        image_is_cut = true;
+        image_cut_ms = millis();
+      }
+    #endif
     else if(camera_get_new_packet()) // Check if new image packet available to send
     {
       DEBUG_PRINT("[IMG] Send: ");
       DEBUG_PRINT((uint32_t)global_freq);
-      DEBUG_PRINTLN((char*) packet_img_base64_buf);
+      DEBUG_PRINTLN(packet_img_base91_buf);
       DEBUG_PRINTLN();
 
       // Send APRS packet
-      aprs_send_status_packet(&global_freq, SX1278_TX_POWER, SX1278_DEVIATION, APRS_SOURCE_CALLSIGN, IMAGE_APRS_SOURCE_SSID, image_packet_counter, (char*) packet_img_base64_buf); // Send aprs image packet
+      uint8_t image_ssid = camera_is_fountain_coded() ? IMAGE_FOUNTAIN_APRS_SOURCE_SSID : IMAGE_APRS_SOURCE_SSID;
+      aprs_send_status_packet(&global_freq, SX1278_TX_POWER, SX1278_DEVIATION, APRS_SOURCE_CALLSIGN, image_ssid, image_packet_counter, packet_img_base91_buf); // Send aprs image packet
       image_packet_counter++; // Increment image packet counter
     }
     else // Capture new image after the last one was send
@@ -243,27 +354,66 @@ void main_generate_aprs_position_packet()
 
   void main_capture_image()
   {
-    DEBUG_PRINTLN("[CAM] Init");
-    camera_init(); // Initialize camera
+    camera_set_packet_error_rate(main_get_packet_error_rate()); // Choose SSDV FEC for the expected link quality
+    #ifdef IMAGE_ADAPTIVE_ENABLE
+      camera_set_packet_budget(main_get_image_packet_budget()); // Choose frame size and quality before auto exposure settles, counts packets of the chosen FEC
+    #endif
+
+    DEBUG_PRINTLN("[CAM] Wake");
+    uint32_t settle_ms = camera_wake(); // Initialize camera or wake it from standby
     MCU_SET_FREQ_NORMAL; // Clock down MCU to save power
 
-    gps_proccess_for_ms(2000); // Needed for OV2640 to properly adjust brightness
+    // Needed for OV2640 to properly adjust brightness, capture as soon as exposure converged
+    uint32_t settle_start_ms = millis();
+    do
+    {
+      gps_proccess_for_ms(OV2640_AE_POLL_MS); // Sleep with GPS running
+    } while(!camera_exposure_is_stable() && millis() - settle_start_ms < settle_ms);
 
     camera_capture_image(); // Capture new image
 
-    DEBUG_PRINTLN("[CAM] Disable");
-    camera_deinit(); // Deinit camera
-    camera_disable(); // Disable camera to save power
+    DEBUG_PRINTLN("[CAM] Sleep");
+    camera_sleep(); // Power off camera or put it into standby to save power
+
+    main_save_state(); // Image ID changed
+  }
+
+  // Keep runtime state in RTC memory for a software restart
+  void main_save_state()
+  {
+    state_t state;
+    state.aprs_packet_counter = aprs_packet_counter;
+    state.image_id = camera_get_image_id();
+    state.gps_days = gps_days;
+    state_save(&state);
+  }
+
+  // Get SSDV packets the next image may take from solar power and local time of day
+  uint16_t main_get_image_packet_budget()
+  {
+    uint16_t packet_budget = IMAGE_BUDGET_PACKETS;
+
+    if(solar_voltage < IMAGE_BUDGET_SOLAR_LOW) packet_budget /= 4;
+    else if(solar_voltage < IMAGE_BUDGET_SOLAR_HIGH) packet_budget /= 2;
+
+    // Local solar time, 4 minutes per degree longitude
+    int16_t minute_of_day = gps_get_minute_of_day();
+    if(minute_of_day >= 0)
+    {
+      int16_t DD_latitude_buf;
+      int16_t DD_longitude_buf;
+      gps_convert_coordinates_to_DD(&DD_latitude_buf, &DD_longitude_buf);
+
+      int16_t local_minute_of_day = (minute_of_day + (int32_t) DD_longitude_buf * 4 / 100 + 1440) % 1440;
+      if(local_minute_of_day < IMAGE_BUDGET_DAY_START || local_minute_of_day > IMAGE_BUDGET_DAY_END) packet_budget /= 2; // Sun low, images cost battery
+    }
+
+    return packet_budget;
   }
 
   #ifdef CACHE_ENABLE
     void main_handle_cache()
     {
-      // Get buffer and index from NVS 
-      uint16_t index;
-      uint16_t element_number;
-      char *tmp_buf = cache_get(&element_number);
-
       // Convert GPS data to deg 
       int16_t DD_latitude_buf;
       int16_t DD_longitude_buf;
@@ -271,52 +421,30 @@ void main_generate_aprs_position_packet()
 
       if(DD_latitude_buf != 0 && DD_longitude_buf != 0) // Add new position to cache
       {
-        char latitude_B91_char = round(0.5 * (DD_latitude_buf/100 + 90)) + 33; // Map -90:90to 0:90 and add 33 for ASCII Base91 encoding
-        char longitude_B91_char = round(0.25 * (DD_longitude_buf/100 + 180)) + 33; // Map -180:180 to 0:90 and add 33 for ASCII Base91 encoding
+        cache_position_t position;
+        position.latitude = DD_latitude_buf;
+        position.longitude = DD_longitude_buf;
+        position.altitude = constrain(altitude, 0L, 65535L);
+        position.time = gps_get_time_minutes();
         
         DEBUG_PRINT("[MAIN] Cache pos: ");
-        DEBUG_PRINT(latitude_B91_char);
-        DEBUG_PRINTLN(longitude_B91_char);
-        
-        if(element_number >= CACHE_LENGTH) index = CACHE_LENGTH; // Set index to last position, if cache full
-        else index = element_number;
-
-        if(index == 0) // Always write new postion, if buffer empty
-        {
-          element_number = cache_push(latitude_B91_char); // Add latitude
-          element_number = cache_push(longitude_B91_char); // Add longitude
-          cache_store(); // Save updated cache
-        }
-        else if(latitude_B91_char != tmp_buf[index-2] || longitude_B91_char != tmp_buf[index-1]) // Check if latest position different from current
-        {
-          if(index >= 4) // If there are more than two positions, also check the second to last position -> this removes oscillations
-          {
-            if(latitude_B91_char != tmp_buf[index-4] || longitude_B91_char != tmp_buf[index-3])
-            {
-              element_number = cache_push(latitude_B91_char); // Add latitude
-              element_number = cache_push(longitude_B91_char); // Add longitude
-              cache_store(); // Save updated cache
-            }
-          }
-          else
-          {
-            element_number = cache_push(latitude_B91_char); // Add latitude
-            element_number = cache_push(longitude_B91_char); // Add longitude
-            cache_store(); // Save updated cache
-          }
-        }
+        DEBUG_PRINT(position.latitude);
+        DEBUG_PRINT(" ");
+        DEBUG_PRINTLN(position.longitude);
+
+        track_add_position(position); // Add position, straight track segments are merged
       }
 
-      if(element_number >= CACHE_LENGTH) index = CACHE_LENGTH; // Set index to last position, if cache full
-      else index = element_number;
+      if(cache_is_dirty()) cache_store(); // Only touch flash if the cache changed
 
-      tmp_buf[index+0] = '|'; // Add end flag
-      tmp_buf[index+1] = (element_number / 2) / 90 + 33; // Add ASCII Base91 encoded element number MSB
-      tmp_buf[index+2] = (element_number / 2) % 90 + 33; // Add ASCII Base91 encoded element number LSB
-      tmp_buf[index+3] = '\0'; // Add null termination
+      // Linearize cache into APRS status comment
+      char cache_frame_buf[CACHE_FRAME_BUF_LENGTH];
+      cache_serialize(cache_frame_buf, CACHE_FRAME_BUF_LENGTH);
 
       // Send APRS packet with cache
-      aprs_send_status_packet(&global_freq, SX1278_TX_POWER, SX1278_DEVIATION, APRS_SOURCE_CALLSIGN, CACHE_APRS_SOURCE_SSID, APRS_DESTINATION_SSID, tmp_buf); // Send aprs image packet
+      aprs_send_status_packet(&global_freq, SX1278_TX_POWER, SX1278_DEVIATION, APRS_SOURCE_CALLSIGN, CACHE_APRS_SOURCE_SSID, APRS_DESTINATION_SSID, cache_frame_buf); // Send aprs cache packet
+
+      cache_compact(); // Erase oldest flash log sector ahead of time
     }
   #endif
 #endif
@@ -30,6 +30,14 @@
   #define SX1278_NRESET 7                                                                                        
   #define SX1278_DIO2 6 
 
+  // SX1278 NSS as direct port access, SX1278_NSS is PD5
+  #define SX1278_NSS_LOW PORTD &= ~_BV(PD5)
+  #define SX1278_NSS_HIGH PORTD |= _BV(PD5)
+
+  // SX1278 DIO2 as direct port access, SX1278_DIO2 is PD6
+  #define SX1278_DIO2_LOW PORTD &= ~_BV(PD6)
+  #define SX1278_DIO2_HIGH PORTD |= _BV(PD6)
+
   // DS18B20 hardware pin definitions
   #define DS18B20_OW 2
 
@@ -42,6 +50,13 @@
   #define SX1278_NRESET 12                                                                                        
   #define SX1278_DIO2 22 
 
+  // SX1278 NSS and DIO2 as direct GPIO register access, one store instead of the GPIO HAL
+  #include "soc/gpio_struct.h"
+  #define SX1278_NSS_LOW GPIO.out_w1tc = (1UL << SX1278_NSS)
+  #define SX1278_NSS_HIGH GPIO.out_w1ts = (1UL << SX1278_NSS)
+  #define SX1278_DIO2_LOW GPIO.out_w1tc = (1UL << SX1278_DIO2)
+  #define SX1278_DIO2_HIGH GPIO.out_w1ts = (1UL << SX1278_DIO2)
+
   // DS18B20 hardware pin definitions
   #define DS18B20_OW -1
 
@@ -0,0 +1,82 @@
+/*
+ * This file is part of a radiosonde firmware.
+ * 
+ 
+ * Copyright (C) 2023  Amon Schumann / DL9AS
+ 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */ 
+
+#include <Arduino.h>
+
+#include "state.h"
+#include "globals.h"
+
+/*
+ * The state block is placed in RTC slow memory, which is not initialized by the bootloader. So it keeps its content
+ * across software restarts, e.g. by camera_panic() or the watchdog, but holds random data after power on. A version,
+ * length and CRC check tells both apart. Writing the block is only a RAM write, so it can be updated after every
+ * packet without wearing the flash.
+ */
+
+// State block in RTC memory
+typedef struct
+{
+  uint16_t version;
+  uint16_t length; // Size of state_t
+  state_t state;
+  uint16_t crc; // CRC over all previous fields
+} state_block_t;
+
+// Module globals
+RTC_NOINIT_ATTR state_block_t state_block;
+
+// Module functions
+
+// CRC-16/CCITT-FALSE
+static uint16_t state_crc(const uint8_t* data, uint16_t length)
+{
+  uint16_t crc = 0xFFFF;
+
+  for(uint16_t i = 0; i < length; i++)
+  {
+    crc ^= (uint16_t) data[i] << 8;
+    for(uint8_t bit = 0; bit < 8; bit++) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+
+  return crc;
+}
+
+// Exported functions
+
+// Get state from RTC memory, returns false after power on or if the state block is invalid
+bool state_restore(state_t* p_state)
+{
+  if(state_block.version != STATE_VERSION || state_block.length != sizeof(state_t) || state_block.crc != state_crc((const uint8_t*) &state_block, offsetof(state_block_t, crc)))
+  {
+    return false;
+  }
+
+  *p_state = state_block.state;
+
+  return true;
+}
+
+void state_save(const state_t* p_state)
+{
+  state_block.version = STATE_VERSION;
+  state_block.length = sizeof(state_t);
+  state_block.state = *p_state;
+  state_block.crc = state_crc((const uint8_t*) &state_block, offsetof(state_block_t, crc));
+}
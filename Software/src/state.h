@@ -0,0 +1,42 @@
+/*
+ * This file is part of a radiosonde firmware.
+ * 
+ 
+ * Copyright (C) 2023  Amon Schumann / DL9AS
+ 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */ 
+
+#ifndef __STATE__H__
+#define __STATE__H__
+
+#include <Arduino.h>
+
+#include "config.h"
+
+#define STATE_VERSION 1 // Increment if state_t changes, an old state block is then ignored
+
+// Runtime state kept across software restarts
+typedef struct
+{
+  uint16_t aprs_packet_counter;
+  uint16_t image_id; // Next SSDV image ID
+  uint16_t gps_days; // Days since 2000-01-01 of the last GPS date
+} state_t;
+
+// Exported functions
+bool state_restore(state_t* p_state);
+void state_save(const state_t* p_state);
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ * This file is part of a radiosonde firmware.
+ * 
+ 
+ * Copyright (C) 2023  Amon Schumann / DL9AS
+ 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */ 
+
+#include <Arduino.h>
+
+#include "track.h"
+#include "cache.h"
+#include "config.h"
+#include "globals.h"
+
+/*
+ * Streaming track simplification (sliding window):
+ * The newest cached position is the floating end point of a straight segment starting at the position before it
+ * (anchor). A new position replaces the end point, if the end point and all positions merged into the segment so
+ * far stay within CACHE_SIMPLIFY_TOLERANCE of the straight line from the anchor to the new position. Otherwise the
+ * new position is pushed and starts the next segment. At most CACHE_SIMPLIFY_WINDOW positions are merged into
+ * one segment, so working memory is bounded. Like the cache it works on, this module is only built for TARGET_RS_4.
+ */
+
+// Module globals
+int16_t track_window_latitude[CACHE_SIMPLIFY_WINDOW]; // Positions merged into the current segment
+int16_t track_window_longitude[CACHE_SIMPLIFY_WINDOW];
+uint8_t track_window_length = 0;
+
+// Module functions
+
+// Longitude difference wrapped to -18000:18000 (decimal degrees *100)
+static int32_t track_longitude_delta(int16_t from, int16_t to)
+{
+  int32_t delta = (int32_t) to - from;
+  if(delta > 18000) delta -= 36000; // Crossing the date line
+  else if(delta < -18000) delta += 36000;
+  return delta;
+}
+
+// Check if point is within tolerance of the segment from anchor to end - all in decimal degrees *100
+static bool track_point_is_on_segment(const cache_position_t* anchor, const cache_position_t* end, int16_t latitude, int16_t longitude)
+{
+  float longitude_scale = cos(anchor->latitude * (PI / 18000.0)); // Shorten longitude towards the poles
+
+  float segment_x = track_longitude_delta(anchor->longitude, end->longitude) * longitude_scale;
+  float segment_y = end->latitude - anchor->latitude;
+  float point_x = track_longitude_delta(anchor->longitude, longitude) * longitude_scale;
+  float point_y = latitude - anchor->latitude;
+
+  float segment_length_sq = segment_x * segment_x + segment_y * segment_y;
+
+  // Degenerated segment -> distance to anchor
+  if(segment_length_sq == 0) return point_x * point_x + point_y * point_y <= (float) CACHE_SIMPLIFY_TOLERANCE * CACHE_SIMPLIFY_TOLERANCE;
+
+  // Distance to the line: |cross product| / segment length
+  float cross = segment_x * point_y - segment_y * point_x;
+  return cross * cross <= (float) CACHE_SIMPLIFY_TOLERANCE * CACHE_SIMPLIFY_TOLERANCE * segment_length_sq;
+}
+
+// Exported functions
+void track_add_position(cache_position_t position)
+{
+  cache_lock();
+
+  cache_iterator_t iterator;
+  cache_position_t end;
+  cache_position_t anchor;
+  cache_iterator_begin(&iterator);
+
+  bool has_segment = cache_iterator_next(&iterator, &end) && cache_iterator_next(&iterator, &anchor);
+  bool merge = has_segment && track_window_length < CACHE_SIMPLIFY_WINDOW;
+
+  // Current end point and all merged positions must stay close to the new segment
+  if(merge) merge = track_point_is_on_segment(&anchor, &position, end.latitude, end.longitude);
+  for(uint8_t i = 0; i < track_window_length && merge; i++)
+  {
+    merge = track_point_is_on_segment(&anchor, &position, track_window_latitude[i], track_window_longitude[i]);
+  }
+
+  if(merge)
+  {
+    track_window_latitude[track_window_length] = end.latitude;
+    track_window_longitude[track_window_length] = end.longitude;
+    track_window_length++;
+
+    cache_replace_newest(position); // Move end point of straight segment
+
+    DEBUG_PRINTLN("[TRACK] Merged");
+  }
+  else
+  {
+    track_window_length = 0;
+
+    cache_push(position); // Start next segment
+
+    DEBUG_PRINTLN("[TRACK] New segment");
+  }
+
+  cache_unlock();
+}
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+#
+# This file is part of a radiosonde firmware.
+#
+# Copyright (C) 2023  Amon Schumann / DL9AS
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Check the phase continuous AFSK of SX1278_MOD_OPTION MOD_F_HOP_DDS (see
+SX1278_mod_dds_bit() in src/SX1278.cpp) on the host.
+
+--table prints the sine table for src/SX1278.cpp. --wav renders the FM
+demodulated audio of random bits with the same integer math as the firmware,
+the frequency register holds each step until the next sample, so the file can
+be fed into an AFSK decoder or looked at in an audio editor. The mark and space
+tones are estimated from the rendered samples.
+
+Usage: afsk_dds.py --table
+       afsk_dds.py --wav out.wav [--bits 2000] [--sample-rate 9600]
+"""
+
+import argparse
+import math
+import random
+import struct
+import wave
+
+CRYSTAL_FREQ = 32000000 # Must match SX1278_CRYSTAL_FREQ in config.h
+DEVIATION = 3000 # Must match SX1278_DEVIATION in config.h
+TABLE_BITS = 6 # Must match SX1278_DDS_TABLE_BITS in SX1278.cpp
+BAUD_RATE = 1200
+MARK_FREQ = 1200
+SPACE_FREQ = 2200
+WAV_RATE = 48000
+
+
+def sine_table():
+    size = 1 << TABLE_BITS
+    return [int(round(127 * math.sin(2 * math.pi * i / size))) for i in range(size)]
+
+
+def phase_inc(freq, sample_rate):
+    # Must match SX1278_DDS_PHASE_INC()
+    return (freq * 65536 + sample_rate // 2) // sample_rate
+
+
+def frequency_steps(bits, sample_rate):
+    # Frequency offset from the carrier in register steps per sample, like SX1278_mod_dds_bit()
+    table = sine_table()
+    amplitude = ((DEVIATION << 19) + CRYSTAL_FREQ // 2) // CRYSTAL_FREQ
+    phase = 0
+    steps = []
+    for bit in bits:
+        inc = phase_inc(MARK_FREQ if bit else SPACE_FREQ, sample_rate)
+        for _ in range(sample_rate // BAUD_RATE):
+            phase = (phase + inc) & 0xFFFF
+            steps.append((table[phase >> (16 - TABLE_BITS)] * amplitude) >> 7)
+    return steps, amplitude
+
+
+def tone_frequency(samples, rate):
+    # Count rising zero crossings
+    crossings = sum(1 for a, b in zip(samples, samples[1:]) if a < 0 <= b)
+    return crossings * rate / len(samples)
+
+
+def render(steps, sample_rate, amplitude):
+    # Zero order hold of the frequency register, scaled to int16
+    hold = WAV_RATE // sample_rate
+    return [int(step * 32767 / amplitude) for step in steps for _ in range(hold)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--table', action='store_true', help='print the sine table for SX1278.cpp')
+    parser.add_argument('--wav', help='write the rendered audio of random bits to this file')
+    parser.add_argument('--bits', type=int, default=2000)
+    parser.add_argument('--sample-rate', type=int, default=9600, help='must match SX1278_DDS_SAMPLE_RATE')
+    args = parser.parse_args()
+
+    if args.table:
+        table = sine_table()
+        for i in range(0, len(table), 16):
+            print('    ' + ', '.join(str(v) for v in table[i:i + 16]) + (',' if i + 16 < len(table) else ''))
+        return
+
+    if args.sample_rate % BAUD_RATE or WAV_RATE % args.sample_rate:
+        parser.error('sample rate must be a multiple of 1200 and divide 48000')
+
+    bits = [random.getrandbits(1) for _ in range(args.bits)]
+    steps, amplitude = frequency_steps(bits, args.sample_rate)
+    print('Amplitude: %d steps (%.0f Hz peak deviation)' % (amplitude, amplitude * CRYSTAL_FREQ / 2 ** 19))
+
+    for name, freq in (('Mark', MARK_FREQ), ('Space', SPACE_FREQ)):
+        tone, _ = frequency_steps([freq == MARK_FREQ] * 100, args.sample_rate)
+        measured = tone_frequency(render(tone, args.sample_rate, amplitude), WAV_RATE)
+        print('%s: %d Hz, phase step %d, measured %.1f Hz' % (name, freq, phase_inc(freq, args.sample_rate), measured))
+
+    if args.wav:
+        samples = render(steps, args.sample_rate, amplitude)
+        with wave.open(args.wav, 'wb') as out:
+            out.setnchannels(1)
+            out.setsampwidth(2)
+            out.setframerate(WAV_RATE)
+            out.writeframes(struct.pack('<%dh' % len(samples), *samples))
+        print('Wrote %d bits, %d samples to %s' % (len(bits), len(samples), args.wav))
+
+
+if __name__ == '__main__':
+    main()
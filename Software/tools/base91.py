@@ -0,0 +1,256 @@
+#!/usr/bin/env python3
+#
+# This file is part of a radiosonde firmware.
+#
+# Copyright (C) 2023  Amon Schumann / DL9AS
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+basE91 text encoding of image packets (see src/base91.cpp) and reassembly of
+received SSDV packets, which can then be decoded with 'ssdv -d'.
+
+Input: text file with one received APRS status comment per line, the basE91
+payload with or without the leading '>'. The sync byte, packet type and
+callsign stripped on air are restored, the packet type (NOFEC or Reed-Solomon
+FEC) is found by the CRC position.
+
+Usage: base91.py frames.txt [-o packets.bin]
+       base91.py --self-test
+"""
+
+import argparse
+import binascii
+import os
+import random
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+ALPHABET = ''.join(chr(c) for c in range(ord('!'), ord('z') + 1)) + '}' # Must match base91_get_char()
+VALUES = {c: i for i, c in enumerate(ALPHABET)}
+
+PACKET_LENGTH = 195 # Must match IMAGE_PACKET_LENGTH in config.h
+PACKET_SSDV_OFFSET = 6 # Must match IMAGE_PACKET_SSDV_OFFSET in camera.h
+FEC_LENGTH = 32 # Must match IMAGE_PACKET_FEC_LENGTH in camera.h
+SSDV_TYPE_FEC = 0x66
+SSDV_TYPE_NOFEC = 0x67
+
+# Output of base91_encode() in src/base91.cpp
+REFERENCE_VECTORS = [
+    (b'', ''),
+    (b'\x00', '!!'),
+    (b'\xff', 'j#'),
+    (b'test', '@0.+>'),
+    (bytes(8), '!!!!!!!!!!'),
+    (b'The quick brown fox jumps over the lazy dog', "H8t)Tp4VM_WNk;2H`IoP@o[#^`v``GF,+`uVk7TPl2'_h;bKX,=n:"),
+]
+
+# Drives src/base91.cpp: 'e <hex>' prints the encoded text, 'd <text>' prints the decoded hex or 'invalid'
+C_HARNESS = r'''
+#include <stdio.h>
+#include <string.h>
+#include "base91.h"
+
+int main()
+{
+  static char line[4096];
+  static uint8_t data[2048];
+  static char text[4096];
+
+  while(fgets(line, sizeof(line), stdin) != NULL)
+  {
+    line[strcspn(line, "\n")] = '\0';
+    size_t length = 0;
+
+    if(line[0] == 'e')
+    {
+      for(const char* p = line + 2; p[0] != '\0' && p[1] != '\0'; p += 2) sscanf(p, "%2hhx", &data[length++]);
+      base91_encode(data, length, text);
+      printf("%s\n", text);
+    }
+    else if(!base91_decode(line + 2, data, &length))
+    {
+      printf("invalid\n");
+    }
+    else
+    {
+      for(size_t i = 0; i < length; i++) printf("%02x", data[i]);
+      printf("\n");
+    }
+  }
+
+  return 0;
+}
+'''
+
+
+def encode(data):
+    text = []
+    bits = 0
+    bit_count = 0
+    for byte in data:
+        bits |= byte << bit_count
+        bit_count += 8
+        if bit_count > 13:
+            value = bits & 0x1FFF
+            if value > 88:
+                bits >>= 13
+                bit_count -= 13
+            else:
+                value = bits & 0x3FFF
+                bits >>= 14
+                bit_count -= 14
+            text += [ALPHABET[value % 91], ALPHABET[value // 91]]
+    if bit_count:
+        text.append(ALPHABET[bits % 91])
+        if bit_count > 7 or bits > 90:
+            text.append(ALPHABET[bits // 91])
+    return ''.join(text)
+
+
+def decode(text):
+    # Raises ValueError on characters outside the alphabet
+    data = bytearray()
+    bits = 0
+    bit_count = 0
+    value = -1
+    for c in text:
+        if c not in VALUES:
+            raise ValueError('invalid basE91 character %r' % c)
+        if value < 0:
+            value = VALUES[c]
+            continue
+        value += VALUES[c] * 91
+        bits |= value << bit_count
+        bit_count += 13 if (value & 0x1FFF) > 88 else 14
+        while True:
+            data.append(bits & 0xFF)
+            bits >>= 8
+            bit_count -= 8
+            if bit_count <= 7:
+                break
+        value = -1
+    if value >= 0:
+        data.append((bits | value << bit_count) & 0xFF)
+    return bytes(data)
+
+
+def parse_packet(line):
+    # Rebuild a full SSDV packet from a received status comment, None if damaged
+    try:
+        body = decode(line.strip().lstrip('>'))
+    except ValueError:
+        return None
+    if len(body) != PACKET_LENGTH - PACKET_SSDV_OFFSET:
+        return None
+    for packet_type, crc_end in ((SSDV_TYPE_NOFEC, PACKET_LENGTH - 4), (SSDV_TYPE_FEC, PACKET_LENGTH - 4 - FEC_LENGTH)):
+        packet = bytes([0x55, packet_type, 0, 0, 0, 0]) + body
+        crc = binascii.crc32(packet[1:crc_end]) & 0xFFFFFFFF
+        if struct.pack('>I', crc) == packet[crc_end:crc_end + 4]:
+            return packet
+    return None
+
+
+def run_c_harness(requests):
+    # Compile src/base91.cpp with a host compiler, None if there is none
+    compiler = shutil.which('c++') or shutil.which('g++')
+    if compiler is None:
+        return None
+    src_dir = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'src')
+    with tempfile.TemporaryDirectory() as build_dir:
+        with open(os.path.join(build_dir, 'Arduino.h'), 'w') as header:
+            header.write('#include <stdint.h>\n#include <stddef.h>\n')
+        with open(os.path.join(build_dir, 'harness.cpp'), 'w') as harness:
+            harness.write(C_HARNESS)
+        binary = os.path.join(build_dir, 'harness')
+        subprocess.run([compiler, '-DBASE91_DECODE_ENABLE', '-I', build_dir, '-I', src_dir,
+                        os.path.join(build_dir, 'harness.cpp'), os.path.join(src_dir, 'base91.cpp'), '-o', binary], check=True)
+        result = subprocess.run([binary], input='\n'.join(requests) + '\n', capture_output=True, text=True, check=True)
+    return result.stdout.splitlines()
+
+
+def self_test():
+    failures = 0
+
+    for data, text in REFERENCE_VECTORS:
+        if encode(data) != text or decode(text) != data:
+            print('FAIL reference vector %r' % text)
+            failures += 1
+
+    rng = random.Random(91)
+    buffers = [bytes(rng.getrandbits(8) for _ in range(length)) for length in range(300)]
+    buffers += [bytes([value]) * length for value in (0x00, 0xFF) for length in range(1, 64)]
+    for data in buffers:
+        if decode(encode(data)) != data:
+            print('FAIL round trip of %d bytes' % len(data))
+            failures += 1
+
+    for text in ('ab|c', 'ab~', 'ab{c', 'a b'):
+        try:
+            decode(text)
+            print('FAIL accepted invalid %r' % text)
+            failures += 1
+        except ValueError:
+            pass
+
+    # Same vectors through the firmware encoder and the host only decoder of src/base91.cpp
+    texts = [encode(data) for data in buffers]
+    requests = ['e ' + data.hex() for data in buffers] + ['d ' + text for text in texts] + ['d ab|c', 'd ab~']
+    replies = run_c_harness(requests)
+    if replies is None:
+        print('No host C++ compiler, src/base91.cpp not checked')
+    else:
+        expected = texts + [data.hex() for data in buffers] + ['invalid', 'invalid']
+        for request, reply, want in zip(requests, replies, expected):
+            if reply != want:
+                print('FAIL src/base91.cpp %s' % request[:40])
+                failures += 1
+        if len(replies) != len(expected):
+            print('FAIL src/base91.cpp replied %d of %d' % (len(replies), len(expected)))
+            failures += 1
+
+    print('%d buffers checked, %d failures' % (len(buffers), failures))
+    return failures == 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Rebuild SSDV packets from basE91 image frames')
+    parser.add_argument('frames', nargs='?', help='text file with one received status comment per line')
+    parser.add_argument('-o', '--output', default='packets.bin', help='SSDV packet file for ssdv -d')
+    parser.add_argument('--self-test', action='store_true', help='check encoder and decoder here and in src/base91.cpp')
+    args = parser.parse_args()
+
+    if args.self_test:
+        sys.exit(0 if self_test() else 1)
+    if args.frames is None:
+        parser.error('frames file required')
+
+    packets = []
+    with open(args.frames) as frames:
+        for line in frames:
+            packet = parse_packet(line)
+            if packet is not None and packet not in packets:
+                packets.append(packet)
+
+    with open(args.output, 'wb') as output:
+        for packet in packets:
+            output.write(packet)
+    print('%d packets written to %s' % (len(packets), args.output))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+#
+# This file is part of a radiosonde firmware.
+#
+# Copyright (C) 2023  Amon Schumann / DL9AS
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Generate the igate reception likelihood grid (src/coverage_grid.h) from a CSV
+file with igate locations.
+
+CSV format: one igate per line, latitude and longitude in decimal degrees in
+the first two columns. Lines that can not be parsed (e.g. a header) are skipped.
+
+Usage: coverage_grid.py igates.csv [-o ../src/coverage_grid.h] [--radius-km 400]
+"""
+
+import argparse
+import csv
+import math
+
+GRID_STEP_DEG = 5 # Must match COVERAGE_GRID_STEP in coverage.h
+GRID_ROWS = 180 // GRID_STEP_DEG
+GRID_COLUMNS = 360 // GRID_STEP_DEG
+
+EARTH_RADIUS_KM = 6371.0
+
+# Level thresholds: number of igates within radius of the cell center
+LEVEL_NONE = 0
+LEVEL_LOW = 1
+LEVEL_MEDIUM = 2
+LEVEL_HIGH = 3
+
+
+def read_igates(path):
+    igates = []
+    with open(path, newline='') as f:
+        for row in csv.reader(f):
+            try:
+                lat = float(row[0])
+                lon = float(row[1])
+            except (ValueError, IndexError):
+                continue # Skip header and broken lines
+            if -90 <= lat <= 90 and -180 <= lon <= 180:
+                igates.append((math.radians(lat), math.radians(lon)))
+    return igates
+
+
+def distance_km(lat1, lon1, lat2, lon2):
+    # Haversine great circle distance
+    a = math.sin((lat2 - lat1) / 2) ** 2 + math.cos(lat1) * math.cos(lat2) * math.sin((lon2 - lon1) / 2) ** 2
+    return 2 * EARTH_RADIUS_KM * math.asin(min(1.0, math.sqrt(a)))
+
+
+def cell_level(count, low, medium, high):
+    if count >= high:
+        return LEVEL_HIGH
+    if count >= medium:
+        return LEVEL_MEDIUM
+    if count >= low:
+        return LEVEL_LOW
+    return LEVEL_NONE
+
+
+def build_grid(igates, radius_km, low, medium, high):
+    grid = []
+    for row in range(GRID_ROWS):
+        lat = math.radians(-90 + (row + 0.5) * GRID_STEP_DEG)
+        for column in range(GRID_COLUMNS):
+            lon = math.radians(-180 + (column + 0.5) * GRID_STEP_DEG)
+            count = sum(1 for (i_lat, i_lon) in igates if distance_km(lat, lon, i_lat, i_lon) <= radius_km)
+            grid.append(cell_level(count, low, medium, high))
+    return grid
+
+
+def pack_grid(grid):
+    # 4 cells with 2 bit each per byte, first cell in the lowest bits
+    packed = []
+    for i in range(0, len(grid), 4):
+        byte = 0
+        for j, level in enumerate(grid[i:i + 4]):
+            byte |= level << (2 * j)
+        packed.append(byte)
+    return packed
+
+
+def write_header(path, packed, source, igate_count, radius_km):
+    with open(path, 'w', newline='\r\n') as f:
+        f.write('/*\n')
+        f.write(' * This file is generated by tools/coverage_grid.py - do not edit.\n')
+        f.write(' * Source: %s (%d igates), radius %d km\n' % (source, igate_count, radius_km))
+        f.write(' */\n\n')
+        f.write('#ifndef __COVERAGE_GRID__H__\n')
+        f.write('#define __COVERAGE_GRID__H__\n\n')
+        f.write('// %d x %d cells of %d deg, 2 bit reception likelihood per cell\n' % (GRID_ROWS, GRID_COLUMNS, GRID_STEP_DEG))
+        f.write('const PROGMEM_CUSTOM uint8_t coverage_grid[] = {\n')
+        for i in range(0, len(packed), 18):
+            f.write('    ' + ', '.join('0x%02X' % b for b in packed[i:i + 18]) + ',\n')
+        f.write('};\n\n')
+        f.write('#endif\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate igate reception likelihood grid')
+    parser.add_argument('csv', help='CSV file with igate latitude,longitude in decimal degrees')
+    parser.add_argument('-o', '--output', default='../src/coverage_grid.h', help='Output header')
+    parser.add_argument('--radius-km', type=int, default=400, help='Reception radius around each igate (radio horizon at float altitude)')
+    parser.add_argument('--low', type=int, default=1, help='Min igates in radius for level LOW')
+    parser.add_argument('--medium', type=int, default=3, help='Min igates in radius for level MEDIUM')
+    parser.add_argument('--high', type=int, default=20, help='Min igates in radius for level HIGH')
+    args = parser.parse_args()
+
+    igates = read_igates(args.csv)
+    grid = build_grid(igates, args.radius_km, args.low, args.medium, args.high)
+    write_header(args.output, pack_grid(grid), args.csv.split('/')[-1], len(igates), args.radius_km)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+#
+# This file is part of a radiosonde firmware.
+#
+# Copyright (C) 2023  Amon Schumann / DL9AS
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+#
+
+
+"""
+Decode fountain coded image frames (IMAGE_TRANSPORT_FOUNTAIN, see src/fountain.cpp)
+back into SSDV packets, which can then be decoded with 'ssdv -d'.
+
+Input: text file with one received APRS status comment per line, the basE91
+payload with or without the leading '>'. Frames of all igates can simply be
+concatenated, duplicates and frames of other images are sorted out.
+
+Usage: fountain_decode.py frames.txt [-o images]
+       fountain_decode.py --simulate [--packets 300] [--repair-percent 30]
+"""
+
+import argparse
+import binascii
+import random
+import struct
+
+import base91
+
+PACKET_LENGTH = 195 # Must match IMAGE_PACKET_LENGTH in config.h
+SYMBOL_OFFSET = 6 # Must match FOUNTAIN_SYMBOL_OFFSET in fountain.h
+SYMBOL_LENGTH = PACKET_LENGTH - SYMBOL_OFFSET - 4
+HEADER_LENGTH = 4
+
+SSDV_HEADER = bytes([0x55, 0x67, 0x00, 0x00, 0x00, 0x00]) # Sync, packet type NOFEC, empty callsign
+
+def fountain_hash(value):
+    # MurmurHash3 finalizer, must match fountain_hash()
+    value ^= value >> 16
+    value = (value * 0x85EBCA6B) & 0xFFFFFFFF
+    value ^= value >> 13
+    value = (value * 0xC2B2AE35) & 0xFFFFFFFF
+    value ^= value >> 16
+    return value
+
+
+def source_mask(block_id, source_count, sequence):
+    # Repeat the draw of fountain_encode(), bit i set if source symbol i is part of the frame
+    if sequence < source_count:
+        return 1 << sequence
+
+    seed = fountain_hash((block_id << 16) | sequence)
+    mask = 0
+    for word in range((source_count + 31) // 32):
+        mask |= fountain_hash((seed + word * 0x9E3779B9) & 0xFFFFFFFF) << (32 * word)
+    return mask & ((1 << source_count) - 1)
+
+
+class BlockDecoder:
+    # Gaussian elimination over GF(2), symbols and source sets as Python integers
+
+    def __init__(self, block_id, source_count):
+        self.block_id = block_id
+        self.source_count = source_count
+        self.rows = {} # Pivot index -> (mask, symbol)
+        self.sequences = set()
+
+    def add(self, sequence, symbol):
+        if sequence in self.sequences:
+            return # Duplicate heard by another igate
+        self.sequences.add(sequence)
+
+        mask = source_mask(self.block_id, self.source_count, sequence)
+        value = int.from_bytes(symbol, 'big')
+
+        while mask:
+            pivot = mask.bit_length() - 1
+            if pivot not in self.rows:
+                self.rows[pivot] = (mask, value)
+                return
+            row_mask, row_value = self.rows[pivot]
+            mask ^= row_mask
+            value ^= row_value
+
+    def is_complete(self):
+        return len(self.rows) == self.source_count
+
+    def source_symbols(self):
+        # Back substitution, lowest pivots first
+        solved = {}
+        for pivot in sorted(self.rows):
+            mask, value = self.rows[pivot]
+            mask ^= 1 << pivot
+            while mask:
+                index = mask.bit_length() - 1
+                value ^= solved[index]
+                mask ^= 1 << index
+            solved[pivot] = value
+        return [solved[i].to_bytes(SYMBOL_LENGTH, 'big') for i in range(self.source_count)]
+
+
+def parse_frame(line):
+    line = line.strip().lstrip('>')
+    try:
+        frame = base91.decode(line)
+    except ValueError:
+        return None
+    if len(frame) != HEADER_LENGTH + SYMBOL_LENGTH:
+        return None
+    block_id = frame[0]
+    source_count = (frame[1] << 4) | (frame[2] >> 4)
+    sequence = ((frame[2] & 0x0F) << 8) | frame[3]
+    return block_id, source_count, sequence, frame[HEADER_LENGTH:]
+
+
+def ssdv_packet(symbol):
+    packet = SSDV_HEADER + symbol
+    return packet + struct.pack('>I', binascii.crc32(packet[1:]) & 0xFFFFFFFF)
+
+
+def decode(path, output_prefix):
+    decoders = {}
+    with open(path) as f:
+        for line in f:
+            parsed = parse_frame(line)
+            if parsed is None or parsed[1] == 0:
+                continue
+            block_id, source_count, sequence, symbol = parsed
+            key = (block_id, source_count)
+            if key not in decoders:
+                decoders[key] = BlockDecoder(block_id, source_count)
+            decoders[key].add(sequence, symbol)
+
+    for (block_id, source_count), decoder in sorted(decoders.items()):
+        if not decoder.is_complete():
+            print('Block %d: %d of %d source packets, %d frames received' % (block_id, len(decoder.rows), source_count, len(decoder.sequences)))
+            continue
+        path = '%s_%03d.bin' % (output_prefix, block_id)
+        with open(path, 'wb') as f:
+            for symbol in decoder.source_symbols():
+                f.write(ssdv_packet(symbol))
+        print('Block %d: decoded %d packets from %d frames -> %s' % (block_id, source_count, len(decoder.sequences), path))
+
+
+def simulate(packets, repair_percent, runs):
+    # Delivered images per hour against plain SSDV, one packet per RADIO_PACKET_DELAY
+    packet_delay_s = 35
+    fountain_frames = packets * (100 + repair_percent) // 100
+    print('Packet loss | SSDV images/h | Fountain images/h')
+    for loss in (0.01, 0.02, 0.05, 0.1, 0.2):
+        ssdv_complete = 0
+        fountain_complete = 0
+        for run in range(runs):
+            block_id = run % 256
+            ssdv_complete += all(random.random() > loss for _ in range(packets))
+
+            decoder = BlockDecoder(block_id, packets)
+            for sequence in range(fountain_frames):
+                if random.random() > loss:
+                    decoder.add(sequence, bytes(SYMBOL_LENGTH))
+                if decoder.is_complete():
+                    break
+            fountain_complete += decoder.is_complete()
+        ssdv_rate = 3600.0 / (packets * packet_delay_s) * ssdv_complete / runs
+        fountain_rate = 3600.0 / (fountain_frames * packet_delay_s) * fountain_complete / runs
+        print('%10.0f%% | %13.3f | %17.3f' % (loss * 100, ssdv_rate, fountain_rate))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('frames', nargs='?', help='text file with received frames')
+    parser.add_argument('-o', '--output', default='image', help='prefix of decoded SSDV packet files')
+    parser.add_argument('--simulate', action='store_true', help='run loss simulation instead of decoding')
+    parser.add_argument('--packets', type=int, default=300, help='SSDV packets per image for --simulate')
+    parser.add_argument('--repair-percent', type=int, default=30, help='must match IMAGE_FOUNTAIN_REPAIR_PERCENT')
+    parser.add_argument('--runs', type=int, default=50, help='simulated images per loss rate')
+    args = parser.parse_args()
+
+    if args.simulate:
+        simulate(args.packets, args.repair_percent, args.runs)
+    elif args.frames:
+        decode(args.frames, args.output)
+    else:
+        parser.error('frames file or --simulate required')
+
+
+if __name__ == '__main__':
+    main()
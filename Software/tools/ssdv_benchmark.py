@@ -0,0 +1,173 @@
+#!/usr/bin/env python3
+#
+# This file is part of a radiosonde firmware.
+#
+# Copyright (C) 2023  Amon Schumann / DL9AS
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Host benchmark of the SSDV encoder as camera_encode_packet() (see
+src/camera.cpp) drives it: the whole JPEG is handed to ssdv_enc_feed() in one
+call and packets are pulled until the end of image. --chunk 128 feeds fixed
+chunks instead, like the firmware did before, for comparison.
+
+The SSDV library is not part of this repository, point --ssdv-dir to the
+library the firmware is built with (ssdv.h and its .c files), by default the
+PlatformIO library folders are searched. The sample JPEG should be an OV2640
+capture, SSDV needs baseline JPEG with a size in whole 16x16 MCUs.
+
+Usage: ssdv_benchmark.py image.jpg [--ssdv-dir DIR] [--fec] [--quality 3] [--chunk 128] [--repeat 20]
+"""
+
+import argparse
+import glob
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+PACKET_LENGTH = 195 # Must match IMAGE_PACKET_LENGTH in config.h
+SSDV_QUALITY = 3 # Must match SSDV_JPEG_QUALITY in config.h
+
+SOFTWARE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+SSDV_DIRS = [
+    os.path.join(SOFTWARE_DIR, '.pio', 'libdeps', 'TARGET_RS_4', 'ssdv'),
+    os.path.join(SOFTWARE_DIR, 'lib', 'ssdv'),
+    os.path.expanduser(os.path.join('~', 'Documents', 'Arduino', 'libraries', 'ssdv')),
+    os.path.expanduser(os.path.join('~', 'Arduino', 'libraries', 'ssdv')),
+]
+
+# Arguments: jpeg type quality packet_length chunk repeat, chunk 0 feeds the rest of the JPEG in one call
+C_HARNESS = r'''
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ssdv.h"
+
+int main(int argc, char** argv)
+{
+  FILE* f = fopen(argv[1], "rb");
+  if(f == NULL) return 2;
+  fseek(f, 0, SEEK_END);
+  size_t length = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t* jpeg = malloc(length);
+  if(fread(jpeg, 1, length, f) != length) return 2;
+  fclose(f);
+
+  int type = atoi(argv[2]);
+  int quality = atoi(argv[3]);
+  int packet_length = atoi(argv[4]);
+  size_t chunk = atoi(argv[5]);
+  int repeat = atoi(argv[6]);
+
+  static uint8_t packet[256];
+  static ssdv_t ssdv;
+  long packets = 0;
+  struct timespec start, end;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(int r = 0; r < repeat; r++)
+  {
+    size_t index = 0;
+    char status;
+
+    ssdv_enc_init(&ssdv, type, "", 0, quality, packet_length);
+    ssdv_enc_set_buffer(&ssdv, packet);
+
+    while((status = ssdv_enc_get_packet(&ssdv)) != SSDV_EOI)
+    {
+      if(status == SSDV_OK)
+      {
+        packets++;
+      }
+      else if(status == SSDV_FEED_ME)
+      {
+        if(index == length) break; // No end of image marker
+        size_t feed = chunk > 0 && length - index > chunk ? chunk : length - index;
+        ssdv_enc_feed(&ssdv, jpeg + index, feed);
+        index += feed;
+      }
+      else
+      {
+        fprintf(stderr, "SSDV error %d\n", status);
+        return 1;
+      }
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  printf("%ld %f\n", packets, (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+  return 0;
+}
+'''
+
+
+def find_ssdv_dir(ssdv_dir):
+    for candidate in [ssdv_dir] if ssdv_dir else SSDV_DIRS:
+        if glob.glob(os.path.join(candidate, '**', 'ssdv.h'), recursive=True):
+            return candidate
+    return None
+
+
+def build_harness(ssdv_dir, build_dir):
+    compiler = shutil.which('cc') or shutil.which('gcc')
+    if compiler is None:
+        sys.exit('No host C compiler')
+    headers = glob.glob(os.path.join(ssdv_dir, '**', 'ssdv.h'), recursive=True)
+    sources = [path for path in glob.glob(os.path.join(ssdv_dir, '**', '*.c'), recursive=True)
+               if os.path.basename(path) != 'main.c'] # Command line tool of the library
+    harness = os.path.join(build_dir, 'harness.c')
+    with open(harness, 'w') as f:
+        f.write(C_HARNESS)
+    binary = os.path.join(build_dir, 'harness')
+    includes = sum((['-I', os.path.dirname(header)] for header in headers), [])
+    subprocess.run([compiler, '-O2'] + includes + [harness] + sources + ['-o', binary], check=True)
+    return binary
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('jpeg', help='sample JPEG, e.g. an OV2640 capture')
+    parser.add_argument('--ssdv-dir', help='SSDV library source folder')
+    parser.add_argument('--fec', action='store_true', help='encode Reed-Solomon FEC packets instead of NOFEC')
+    parser.add_argument('--quality', type=int, default=SSDV_QUALITY, help='SSDV quality 0-7')
+    parser.add_argument('--chunk', type=int, default=0, help='feed chunks of X bytes, 0 feeds the whole JPEG at once like the firmware')
+    parser.add_argument('--repeat', type=int, default=20, help='images encoded for the measurement')
+    args = parser.parse_args()
+
+    ssdv_dir = find_ssdv_dir(args.ssdv_dir)
+    if ssdv_dir is None:
+        sys.exit('SSDV library not found, use --ssdv-dir')
+
+    with tempfile.TemporaryDirectory() as build_dir:
+        binary = build_harness(ssdv_dir, build_dir)
+        ssdv_type = 0 if args.fec else 1 # SSDV_TYPE_NORMAL or SSDV_TYPE_NOFEC
+        result = subprocess.run([binary, args.jpeg, str(ssdv_type), str(args.quality), str(PACKET_LENGTH), str(args.chunk), str(args.repeat)],
+                                capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.exit('Encoding failed: ' + result.stderr.strip())
+
+    packets, seconds = result.stdout.split()
+    packets = int(packets)
+    seconds = float(seconds)
+    print('%s: %d packets per image, %s feed' % (os.path.basename(args.jpeg), packets // args.repeat, 'whole JPEG' if args.chunk == 0 else '%d byte' % args.chunk))
+    print('%.0f packets/s, %.1f us per packet on this host' % (packets / seconds, seconds * 1e6 / max(packets, 1)))
+
+
+if __name__ == '__main__':
+    main()